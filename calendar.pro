@@ -1,4 +1,5 @@
 TEMPLATE = subdirs
-SUBDIRS = src
+SUBDIRS = src tools tests
 
 tests.depends = src
+tools.depends = src
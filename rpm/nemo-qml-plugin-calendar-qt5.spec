@@ -18,6 +18,7 @@ Source0:    %{name}-%{version}.tar.bz2
 Source100:  nemo-qml-plugin-calendar-qt5.yaml
 BuildRequires:  pkgconfig(Qt5Core)
 BuildRequires:  pkgconfig(Qt5Qml)
+BuildRequires:  pkgconfig(Qt5Test)
 BuildRequires:  pkgconfig(libmkcal-qt5)
 BuildRequires:  pkgconfig(libkcalcoren-qt5)
 BuildRequires:  pkgconfig(libical)
@@ -25,6 +26,22 @@ BuildRequires:  pkgconfig(libical)
 %description
 %{summary}.
 
+%package tools
+Summary:    Command line tools for the calendar plugin
+Group:      Development/Tools
+Requires:   %{name} = %{version}-%{release}
+
+%description tools
+Benchmark, database generator and query tools running the calendar plugin's engine.
+
+%package tests
+Summary:    Unit tests for the calendar plugin
+Group:      System/Libraries
+Requires:   %{name} = %{version}-%{release}
+
+%description tests
+Unit tests and benchmarks for the calendar plugin's engine.
+
 %prep
 %setup -q -n %{name}-%{version}
 
@@ -57,3 +74,17 @@ rm -rf %{buildroot}
 %{_libdir}/qt5/qml/org/nemomobile/calendar/qmldir
 # >> files
 # << files
+
+%files tools
+%defattr(-,root,root,-)
+%{_bindir}/nemocalendar-bench
+%{_bindir}/nemocalendar-gen
+%{_bindir}/nemocalendar-query
+# >> files tools
+# << files tools
+
+%files tests
+%defattr(-,root,root,-)
+/opt/tests/nemo-qml-plugin-calendar-qt5/tst_*
+# >> files tests
+# << files tests
@@ -39,7 +39,9 @@
 #include "calendareventcache.h"
 #include "calendaragendamodel.h"
 #include "calendarevent.h"
-#include "calendardb.h"
+#include "calendaroccurrencestore.h"
+#include "calendarstats.h"
+#include "calendarrecorder.h"
 
 NemoCalendarAgendaModel::NemoCalendarAgendaModel(QObject *parent)
 : QAbstractListModel(parent), mBuffer(0), mIsComplete(true)
@@ -57,8 +59,10 @@ NemoCalendarAgendaModel::NemoCalendarAgendaModel(QObject *parent)
 
 NemoCalendarAgendaModel::~NemoCalendarAgendaModel()
 {
+    NemoCalendarRecorder::recordAgendaDestroyed(this);
     NemoCalendarEventCache::instance()->cancelAgendaRefresh(this);
-    qDeleteAll(mEvents);
+    for (int ii = 0; ii < mRows.count(); ++ii)
+        delete mRows.at(ii).occurrence;
 }
 
 #ifdef NEMO_USE_QT5
@@ -81,6 +85,8 @@ void NemoCalendarAgendaModel::setStartDate(const QDate &startDate)
     mStartDate = startDate;
     emit startDateChanged();
 
+    NemoCalendarRecorder::recordAgenda(this, mStartDate, mEndDate);
+
     refresh();
 }
 
@@ -97,6 +103,8 @@ void NemoCalendarAgendaModel::setEndDate(const QDate &endDate)
     mEndDate = endDate;
     emit endDateChanged();
 
+    NemoCalendarRecorder::recordAgenda(this, mStartDate, mEndDate);
+
     refresh();
 }
 
@@ -108,113 +116,152 @@ void NemoCalendarAgendaModel::refresh()
     NemoCalendarEventCache::instance()->scheduleAgendaRefresh(this);
 }
 
-static bool eventsEqual(const mKCal::ExtendedCalendar::ExpandedIncidence &e1,
-                        const mKCal::ExtendedCalendar::ExpandedIncidence &e2)
+static bool rowsEqual(qint64 start1, qint64 end1, const KCalCore::Event::Ptr &event1,
+                      qint64 start2, qint64 end2, const KCalCore::Event::Ptr &event2)
 {
-    return e1.first.dtStart == e2.first.dtStart &&
-           e1.first.dtEnd == e2.first.dtEnd &&
-           (e1.second == e2.second || (e1.second && e2.second && e1.second->uid() == e2.second->uid()));
+    return start1 == start2 && end1 == end2 &&
+           (event1 == event2 || (event1 && event2 && event1->uid() == event2->uid()));
 }
 
-static bool eventsLessThan(const mKCal::ExtendedCalendar::ExpandedIncidence &e1,
-                           const mKCal::ExtendedCalendar::ExpandedIncidence &e2)
+void NemoCalendarAgendaModel::doRefresh(const NemoCalendarOccurrenceStore &store, const QVector<int> &indexes, bool reset)
 {
-    if (e1.second.isNull() != e2.second.isNull()) {
-        return e1.second.data() < e2.second.data();
-    } else if (e1.first.dtStart == e2.first.dtStart) {
-        int cmp = QString::compare(e1.second->summary(), e2.second->summary(), Qt::CaseInsensitive);
-        if (cmp == 0) return QString::compare(e1.second->uid(), e2.second->uid()) < 0;
-        else return cmp < 0;
-    } else {
-        return e1.first.dtStart < e2.first.dtStart;
+    NemoCalendarTrace trace(NemoCalendarStats::RefreshStage);
+
+    int oldEventCount = mRows.count();
+
+    // Occurrence objects were rebound by the cache; rows without one keep
+    // their event until matched below
+    for (int ii = 0; ii < mRows.count(); ++ii) {
+        if (mRows.at(ii).occurrence)
+            mRows[ii].event = mRows.at(ii).occurrence->event();
     }
-}
 
-void NemoCalendarAgendaModel::doRefresh(mKCal::ExtendedCalendar::ExpandedIncidenceList newEvents, bool reset)
-{
-    // Filter out excluded notebooks
-    for (int ii = 0; ii < newEvents.count(); ++ii) {
-        if (!NemoCalendarEventCache::instance()->mNotebooks.contains(NemoCalendarDb::calendar()->notebook(newEvents.at(ii).second))) {
-            newEvents.remove(ii);
-            --ii;
+    // Occurrences starting at the same time are ordered by summary, so an
+    // event edited in place can leave the existing rows out of order.  The
+    // merge below relies on them being sorted, so remove any misplaced rows;
+    // they are inserted again at their new position.
+    if (!reset) {
+        for (int ii = 1; ii < mRows.count(); ++ii) {
+            const Row &previous = mRows.at(ii - 1);
+            if (!NemoCalendarOccurrenceStore::lessThan(mRows.at(ii).start, mRows.at(ii).event,
+                                                       previous.start, previous.event))
+                continue;
+
+            // The earlier row is the misplaced one if it also sorts after
+            // the row following the pair
+            int row = ii;
+            if (ii + 1 < mRows.count() &&
+                NemoCalendarOccurrenceStore::lessThan(mRows.at(ii + 1).start, mRows.at(ii + 1).event,
+                                                      previous.start, previous.event))
+                row = ii - 1;
+
+            NemoCalendarEventOccurrence *removed = mRows.at(row).occurrence;
+            beginRemoveRows(QModelIndex(), row, row);
+            mRows.remove(row);
+            endRemoveRows();
+            delete removed;
+            NemoCalendarStats::count(NemoCalendarStats::RowsRemoved);
+            ii = qMax(0, row - 1);
         }
     }
 
-    qSort(newEvents.begin(), newEvents.end(), eventsLessThan);
-
-    int oldEventCount = mEvents.count();
-
     if (reset) {
         beginResetModel();
-        qDeleteAll(mEvents);
-        mEvents.clear();
+        for (int ii = 0; ii < mRows.count(); ++ii)
+            delete mRows.at(ii).occurrence;
+        mRows.clear();
     }
 
-    QList<NemoCalendarEventOccurrence *> events = mEvents;
-
-    int newEventsCounter = 0;
-    int eventsCounter = 0;
+    int next = 0;
+    int row = 0;
 
-    int mEventsIndex = 0;
-
-    while (newEventsCounter < newEvents.count() || eventsCounter < events.count()) {
+    while (next < indexes.count() || row < mRows.count()) {
         // Remove old events
         int removeCount = 0;
-        while ((eventsCounter + removeCount) < events.count() &&
-               (newEventsCounter >= newEvents.count() ||
-                eventsLessThan(events.at(eventsCounter + removeCount)->expandedEvent(),
-                               newEvents.at(newEventsCounter))))
+        while ((row + removeCount) < mRows.count() &&
+               (next >= indexes.count() ||
+                NemoCalendarOccurrenceStore::lessThan(mRows.at(row + removeCount).start, mRows.at(row + removeCount).event,
+                                                      store.start(indexes.at(next)), store.event(indexes.at(next)))))
             removeCount++;
 
         if (removeCount) {
             Q_ASSERT(false == reset);
-            beginRemoveRows(QModelIndex(), mEventsIndex, mEventsIndex + removeCount - 1);
-            mEvents.erase(mEvents.begin() + mEventsIndex, mEvents.begin() + mEventsIndex + removeCount);
+            QList<NemoCalendarEventOccurrence *> removed;
+            for (int ii = row; ii < row + removeCount; ++ii)
+                removed.append(mRows.at(ii).occurrence);
+
+            beginRemoveRows(QModelIndex(), row, row + removeCount - 1);
+            mRows.remove(row, removeCount);
             endRemoveRows();
-            for (int ii = eventsCounter; ii < eventsCounter + removeCount; ++ii)
-                delete events.at(ii);
-            eventsCounter += removeCount;
+            NemoCalendarStats::count(NemoCalendarStats::RowsRemoved, removeCount);
+            qDeleteAll(removed);
         }
 
-        // Skip matching events
-        while (eventsCounter < events.count() && newEventsCounter < newEvents.count() &&
-               eventsEqual(newEvents.at(newEventsCounter), events.at(eventsCounter)->expandedEvent())) {
+        // Skip matching events, taking the event from the store for rows
+        // without an occurrence object
+        while (row < mRows.count() && next < indexes.count() &&
+               rowsEqual(store.start(indexes.at(next)), store.end(indexes.at(next)), store.event(indexes.at(next)),
+                         mRows.at(row).start, mRows.at(row).end, mRows.at(row).event)) {
             Q_ASSERT(false == reset);
-            eventsCounter++;
-            newEventsCounter++;
-            mEventsIndex++;
+            if (!mRows.at(row).occurrence)
+                mRows[row].event = store.event(indexes.at(next));
+            row++;
+            next++;
         }
 
         // Insert new events
         int insertCount = 0;
-        while ((newEventsCounter + insertCount) < newEvents.count() && 
-               (eventsCounter >= events.count() ||
-                eventsLessThan(newEvents.at(newEventsCounter + insertCount),
-                               events.at(eventsCounter)->expandedEvent())))
+        while ((next + insertCount) < indexes.count() &&
+               (row >= mRows.count() ||
+                NemoCalendarOccurrenceStore::lessThan(store.start(indexes.at(next + insertCount)),
+                                                      store.event(indexes.at(next + insertCount)),
+                                                      mRows.at(row).start, mRows.at(row).event)))
             insertCount++;
 
         if (insertCount) {
-            if (!reset) beginInsertRows(QModelIndex(), mEventsIndex, mEventsIndex + insertCount - 1);
+            if (!reset) beginInsertRows(QModelIndex(), row, row + insertCount - 1);
+            mRows.insert(row, insertCount, Row());
             for (int ii = 0; ii < insertCount; ++ii) {
-                NemoCalendarEventOccurrence *event = 
-                    new NemoCalendarEventOccurrence(newEvents.at(newEventsCounter + ii));
-                mEvents.insert(mEventsIndex++, event);
+                int index = indexes.at(next + ii);
+                Row &inserted = mRows[row + ii];
+                inserted.start = store.start(index);
+                inserted.end = store.end(index);
+                inserted.event = store.event(index);
+                inserted.occurrence = 0;
             }
-            newEventsCounter += insertCount;
+            row += insertCount;
+            next += insertCount;
             if (!reset) endInsertRows();
+            NemoCalendarStats::count(NemoCalendarStats::RowsInserted, insertCount);
         }
     }
 
     if (reset)
         endResetModel();
 
-    if (oldEventCount != mEvents.count())
+    if (oldEventCount != mRows.count())
         emit countChanged();
 }
 
+// Occurrence objects are only created for the rows asked for, and then
+// live as long as the row
+NemoCalendarEventOccurrence *NemoCalendarAgendaModel::occurrence(int row) const
+{
+    const Row &r = mRows.at(row);
+    if (!r.occurrence) {
+        mKCal::ExtendedCalendar::ExpandedIncidenceValidity validity = {
+            QDateTime::fromMSecsSinceEpoch(r.start),
+            QDateTime::fromMSecsSinceEpoch(r.end)
+        };
+        r.occurrence = new NemoCalendarEventOccurrence(qMakePair(validity, KCalCore::Incidence::Ptr(r.event)),
+                                                       const_cast<NemoCalendarAgendaModel *>(this));
+    }
+    return r.occurrence;
+}
+
 int NemoCalendarAgendaModel::count() const
 {
-    return mEvents.size();
+    return mRows.count();
 }
 
 int NemoCalendarAgendaModel::minimumBuffer() const
@@ -241,21 +288,21 @@ int NemoCalendarAgendaModel::rowCount(const QModelIndex &index) const
     if (index != QModelIndex())
         return 0;
 
-    return mEvents.size();
+    return mRows.count();
 }
 
 QVariant NemoCalendarAgendaModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || index.row() >= mEvents.count())
+    if (!index.isValid() || index.row() >= mRows.count())
         return QVariant();
 
     switch (role) {
         case EventObjectRole:
-            return QVariant::fromValue<QObject *>(mEvents.at(index.row())->eventObject());
+            return QVariant::fromValue<QObject *>(occurrence(index.row())->eventObject());
         case OccurrenceObjectRole:
-            return QVariant::fromValue<QObject *>(mEvents.at(index.row()));
+            return QVariant::fromValue<QObject *>(occurrence(index.row()));
         case SectionBucketRole:
-            return mEvents.at(index.row())->startTime().date();
+            return QDateTime::fromMSecsSinceEpoch(mRows.at(index.row()).start).date();
         default:
             return QVariant();
     }
@@ -34,6 +34,8 @@
 #define CALENDARAGENDAMODEL_H
 
 #include <QDate>
+#include <QVector>
+#include <event.h>
 #include <extendedcalendar.h>
 #include <QAbstractListModel>
 
@@ -46,6 +48,7 @@
 
 class NemoCalendarEvent;
 class NemoCalendarEventOccurrence;
+class NemoCalendarOccurrenceStore;
 
 class NemoCalendarAgendaModel : public QAbstractListModel, public QQmlParserStatus
 {
@@ -107,12 +110,21 @@ private slots:
 
 private:
     friend class NemoCalendarEventCache;
-    void doRefresh(mKCal::ExtendedCalendar::ExpandedIncidenceList, bool reset = false);
+    void doRefresh(const NemoCalendarOccurrenceStore &store, const QVector<int> &indexes, bool reset = false);
+
+    struct Row {
+        qint64 start;       // msecs since the epoch
+        qint64 end;
+        KCalCore::Event::Ptr event;
+        mutable NemoCalendarEventOccurrence *occurrence;    // created on demand
+    };
+
+    NemoCalendarEventOccurrence *occurrence(int row) const;
 
     QDate mStartDate;
     QDate mEndDate;
     int mBuffer;
-    QList<NemoCalendarEventOccurrence *> mEvents;
+    QVector<Row> mRows;
     QHash<int,QByteArray> mRoleNames;
 
     bool mIsComplete:1;
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendaralarmindex.h"
+
+#include <algorithm>
+
+NemoCalendarAlarmIndex::NemoCalendarAlarmIndex()
+: mNextGeneration(0), mStaleEntries(0), mSyncing(false)
+{
+}
+
+// Brings the index up to date with the incidences currently loaded in
+// calendar.  Only incidences whose revision or modification time changed
+// have their alarms recomputed.
+void NemoCalendarAlarmIndex::sync(const mKCal::ExtendedCalendar::Ptr &calendar)
+{
+    KCalCore::Event::List events = calendar->rawEvents();
+    QSet<QString> seen;
+
+    // Recurring incidences whose exceptions changed are recomputed once at
+    // the end rather than once per exception
+    mSyncing = true;
+
+    for (int ii = 0; ii < events.count(); ++ii) {
+        const KCalCore::Event::Ptr &event = events.at(ii);
+        QString key = instanceKey(event);
+        seen.insert(key);
+
+        QHash<QString, Stamp>::ConstIterator stamp = mStamps.find(key);
+        if (stamp != mStamps.end() && stamp->revision == event->revision() &&
+            stamp->lastModified == event->lastModified())
+            continue;
+
+        update(event);
+    }
+
+    QStringList removed;
+    for (QHash<QString, Stamp>::ConstIterator iter = mStamps.begin(); iter != mStamps.end(); ++iter) {
+        if (!seen.contains(iter.key()))
+            removed.append(iter.key());
+    }
+
+    for (int ii = 0; ii < removed.count(); ++ii)
+        remove(removed.at(ii));
+
+    mSyncing = false;
+
+    QSet<QString> changed = mOverridesChanged;
+    mOverridesChanged.clear();
+    for (QSet<QString>::ConstIterator iter = changed.begin(); iter != changed.end(); ++iter) {
+        QHash<QString, Stamp>::ConstIterator stamp = mStamps.find(*iter);
+        if (stamp != mStamps.end())
+            update(KCalCore::Incidence::Ptr(stamp->incidence));
+    }
+}
+
+void NemoCalendarAlarmIndex::update(const KCalCore::Incidence::Ptr &incidence)
+{
+    if (!incidence)
+        return;
+
+    QString key = instanceKey(incidence);
+    invalidate(key);
+
+    if (incidence->hasRecurrenceId())
+        setOverridden(incidence, true);
+
+    Stamp stamp;
+    stamp.incidence = incidence;
+    stamp.revision = incidence->revision();
+    stamp.lastModified = incidence->lastModified();
+    stamp.generation = mNextGeneration++;
+    stamp.entries = 0;
+
+    KDateTime now = KDateTime::currentUtcDateTime();
+    KCalCore::Alarm::List alarms = incidence->alarms();
+    for (int ii = 0; ii < alarms.count(); ++ii) {
+        if (!alarms.at(ii)->enabled())
+            continue;
+
+        Entry entry;
+        entry.alarm = alarms.at(ii);
+        entry.incidence = incidence;
+        entry.key = key;
+        entry.generation = stamp.generation;
+        if (advance(entry, now)) {
+            push(entry);
+            ++stamp.entries;
+        }
+    }
+
+    mStamps.insert(key, stamp);
+}
+
+void NemoCalendarAlarmIndex::remove(const QString &key)
+{
+    invalidate(key);
+
+    QHash<QString, Stamp>::Iterator stamp = mStamps.find(key);
+    if (stamp == mStamps.end())
+        return;
+
+    KCalCore::Incidence::Ptr incidence = stamp->incidence;
+    mStamps.erase(stamp);
+
+    if (incidence && incidence->hasRecurrenceId())
+        setOverridden(incidence, false);
+}
+
+// Returns the next alarm to trigger, with an invalid trigger time if there
+// is none.  This only looks at the top of the heap.
+NemoCalendarAlarmIndex::Alarm NemoCalendarAlarmIndex::next()
+{
+    prune(KDateTime::currentUtcDateTime());
+
+    return mHeap.isEmpty() ? Alarm() : toAlarm(mHeap.first());
+}
+
+// Returns the next count alarms to trigger, in trigger order.  Recurring
+// incidences may contribute several alarms.
+QList<NemoCalendarAlarmIndex::Alarm> NemoCalendarAlarmIndex::upcoming(int count)
+{
+    QList<Alarm> rv;
+    if (count <= 0)
+        return rv;
+
+    prune(KDateTime::currentUtcDateTime());
+
+    // Continue the merge on a copy so that the index itself only ever holds
+    // the next trigger of each alarm
+    QVector<Entry> heap = mHeap;
+    while (!heap.isEmpty() && rv.count() < count) {
+        std::pop_heap(heap.begin(), heap.end(), entryGreaterThan);
+        Entry &entry = heap.last();
+
+        if (isCurrent(entry)) {
+            rv.append(toAlarm(entry));
+
+            if (advance(entry, KDateTime(entry.trigger, KDateTime::UTC))) {
+                std::push_heap(heap.begin(), heap.end(), entryGreaterThan);
+                continue;
+            }
+        }
+
+        heap.removeLast();
+    }
+
+    return rv;
+}
+
+void NemoCalendarAlarmIndex::calendarIncidenceAdded(const KCalCore::Incidence::Ptr &incidence)
+{
+    update(incidence);
+}
+
+void NemoCalendarAlarmIndex::calendarIncidenceChanged(const KCalCore::Incidence::Ptr &incidence)
+{
+    update(incidence);
+}
+
+void NemoCalendarAlarmIndex::calendarIncidenceDeleted(const KCalCore::Incidence::Ptr &incidence)
+{
+    if (incidence)
+        remove(instanceKey(incidence));
+}
+
+// std heaps keep the greatest element on top, so order by descending trigger
+bool NemoCalendarAlarmIndex::entryGreaterThan(const Entry &e1, const Entry &e2)
+{
+    return e2.trigger < e1.trigger;
+}
+
+QString NemoCalendarAlarmIndex::instanceKey(const KCalCore::Incidence::Ptr &incidence)
+{
+    if (incidence->hasRecurrenceId())
+        return incidence->uid() + QLatin1Char('/') + incidence->recurrenceId().toString();
+    return incidence->uid();
+}
+
+bool NemoCalendarAlarmIndex::isCurrent(const Entry &entry) const
+{
+    QHash<QString, Stamp>::ConstIterator stamp = mStamps.find(entry.key);
+    return stamp != mStamps.end() && stamp->generation == entry.generation;
+}
+
+// True if the trigger of entry belongs to an instance of a recurring
+// incidence that has been replaced by an exception incidence
+bool NemoCalendarAlarmIndex::isOverridden(const Entry &entry) const
+{
+    if (!entry.incidence->recurs())
+        return false;
+
+    QHash<QString, QList<QDateTime> >::ConstIterator overridden = mOverridden.find(entry.incidence->uid());
+    if (overridden == mOverridden.end())
+        return false;
+
+    QDateTime start;
+    if (entry.alarm->hasStartOffset()) {
+        start = entry.trigger.addSecs(-entry.alarm->startOffset().asSeconds());
+    } else if (entry.alarm->hasEndOffset()) {
+        KCalCore::Duration duration(entry.incidence->dtStart(), entry.incidence->dateTime(KCalCore::Incidence::RoleEnd));
+        start = entry.trigger.addSecs(-entry.alarm->endOffset().asSeconds() - duration.asSeconds());
+    } else {
+        return false;
+    }
+
+    return overridden->contains(start);
+}
+
+// Moves entry to the first trigger of its alarm after the given time,
+// taking recurrence and exceptions into account.  Returns false if the
+// alarm does not trigger again.
+bool NemoCalendarAlarmIndex::advance(Entry &entry, const KDateTime &after) const
+{
+    KDateTime from = after;
+    for (;;) {
+        KDateTime next = entry.alarm->nextTime(from, true);
+        if (!next.isValid())
+            return false;
+
+        entry.trigger = next.toUtc().dateTime();
+        if (!isOverridden(entry))
+            return true;
+        from = next;
+    }
+}
+
+NemoCalendarAlarmIndex::Alarm NemoCalendarAlarmIndex::toAlarm(const Entry &entry)
+{
+    Alarm alarm;
+    alarm.uid = entry.incidence->uid();
+    alarm.triggerTime = entry.trigger.toLocalTime();
+    if (entry.alarm->hasStartOffset())
+        alarm.startTime = entry.trigger.addSecs(-entry.alarm->startOffset().asSeconds()).toLocalTime();
+    return alarm;
+}
+
+void NemoCalendarAlarmIndex::push(const Entry &entry)
+{
+    mHeap.append(entry);
+    std::push_heap(mHeap.begin(), mHeap.end(), entryGreaterThan);
+}
+
+void NemoCalendarAlarmIndex::pop()
+{
+    std::pop_heap(mHeap.begin(), mHeap.end(), entryGreaterThan);
+    mHeap.removeLast();
+}
+
+// Drops stale entries from the top of the heap and advances alarms that
+// have already triggered
+void NemoCalendarAlarmIndex::prune(const KDateTime &now)
+{
+    QDateTime utcNow = now.toUtc().dateTime();
+
+    while (!mHeap.isEmpty()) {
+        if (!isCurrent(mHeap.first())) {
+            pop();
+            --mStaleEntries;
+        } else if (mHeap.first().trigger <= utcNow) {
+            Entry entry = mHeap.first();
+            pop();
+            if (advance(entry, now))
+                push(entry);
+            else
+                --mStamps[entry.key].entries;
+        } else {
+            break;
+        }
+    }
+}
+
+// Marks the entries of key as stale, compacting the heap once more than
+// half of it is stale
+void NemoCalendarAlarmIndex::invalidate(const QString &key)
+{
+    QHash<QString, Stamp>::Iterator stamp = mStamps.find(key);
+    if (stamp == mStamps.end())
+        return;
+
+    mStaleEntries += stamp->entries;
+    stamp->generation = -1;
+    stamp->entries = 0;
+
+    if (mStaleEntries * 2 <= mHeap.count())
+        return;
+
+    QVector<Entry> heap;
+    heap.reserve(mHeap.count() - mStaleEntries);
+    for (int ii = 0; ii < mHeap.count(); ++ii) {
+        if (isCurrent(mHeap.at(ii)))
+            heap.append(mHeap.at(ii));
+    }
+
+    mHeap = heap;
+    std::make_heap(mHeap.begin(), mHeap.end(), entryGreaterThan);
+    mStaleEntries = 0;
+}
+
+// Records or forgets the instance replaced by the exception incidence, and
+// recomputes the alarms of the recurring incidence it belongs to
+void NemoCalendarAlarmIndex::setOverridden(const KCalCore::Incidence::Ptr &exception, bool overridden)
+{
+    QString uid = exception->uid();
+    QDateTime recurrenceId = exception->recurrenceId().toUtc().dateTime();
+
+    QList<QDateTime> &ids = mOverridden[uid];
+    if (overridden == ids.contains(recurrenceId)) {
+        if (ids.isEmpty())
+            mOverridden.remove(uid);
+        return;
+    }
+
+    if (overridden)
+        ids.append(recurrenceId);
+    else
+        ids.removeOne(recurrenceId);
+    if (ids.isEmpty())
+        mOverridden.remove(uid);
+
+    if (mSyncing) {
+        mOverridesChanged.insert(uid);
+        return;
+    }
+
+    QHash<QString, Stamp>::ConstIterator stamp = mStamps.find(uid);
+    if (stamp != mStamps.end())
+        update(KCalCore::Incidence::Ptr(stamp->incidence));
+}
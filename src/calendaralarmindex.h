@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARALARMINDEX_H
+#define CALENDARALARMINDEX_H
+
+#include <QSet>
+#include <QHash>
+#include <QVector>
+#include <QDateTime>
+
+// mkcal
+#include <event.h>
+#include <extendedcalendar.h>
+
+// Keeps the next trigger time of every enabled alarm in a min-heap, so the
+// next alarm due across the calendar is found without expanding recurrences.
+class NemoCalendarAlarmIndex : public KCalCore::Calendar::CalendarObserver
+{
+public:
+    struct Alarm {
+        QString uid;
+        QDateTime triggerTime;
+        QDateTime startTime;
+    };
+
+    NemoCalendarAlarmIndex();
+
+    void sync(const mKCal::ExtendedCalendar::Ptr &calendar);
+    void update(const KCalCore::Incidence::Ptr &incidence);
+    void remove(const QString &key);
+
+    Alarm next();
+    QList<Alarm> upcoming(int count);
+
+    /* KCalCore::Calendar::CalendarObserver */
+    void calendarIncidenceAdded(const KCalCore::Incidence::Ptr &incidence);
+    void calendarIncidenceChanged(const KCalCore::Incidence::Ptr &incidence);
+    void calendarIncidenceDeleted(const KCalCore::Incidence::Ptr &incidence);
+
+private:
+    // The alarm refers back to its incidence by a plain pointer, so the
+    // entry holds a reference to keep it alive
+    struct Entry {
+        QDateTime trigger;      // UTC
+        KCalCore::Alarm::Ptr alarm;
+        KCalCore::Incidence::Ptr incidence;
+        QString key;
+        int generation;
+    };
+
+    struct Stamp {
+        KCalCore::Incidence::Ptr incidence;
+        int revision;
+        KDateTime lastModified;
+        int generation;
+        int entries;
+    };
+
+    static bool entryGreaterThan(const Entry &, const Entry &);
+    static QString instanceKey(const KCalCore::Incidence::Ptr &);
+
+    bool isCurrent(const Entry &) const;
+    bool isOverridden(const Entry &) const;
+    bool advance(Entry &, const KDateTime &after) const;
+    static Alarm toAlarm(const Entry &);
+    void push(const Entry &);
+    void pop();
+    void prune(const KDateTime &now);
+    void invalidate(const QString &key);
+    void setOverridden(const KCalCore::Incidence::Ptr &exception, bool overridden);
+
+    // Entries of incidences that have since changed or gone are left in the
+    // heap and skipped when they reach the top
+    QVector<Entry> mHeap;
+    QHash<QString, Stamp> mStamps;
+    int mNextGeneration;
+    int mStaleEntries;
+
+    // Instances of recurring incidences replaced by an exception incidence,
+    // as UTC recurrence ids by uid.  The recurring incidence skips them and
+    // the exception contributes its own alarms.
+    QHash<QString, QList<QDateTime> > mOverridden;
+    bool mSyncing;
+    QSet<QString> mOverridesChanged;
+};
+
+#endif // CALENDARALARMINDEX_H
@@ -34,13 +34,29 @@
 
 #include <QSettings>
 #include <QQmlEngine>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QUrl>
+#include <QFile>
 #include "calendardb.h"
 #include "calendarevent.h"
 #include "calendareventcache.h"
+#include "calendarimporter.h"
+#include "calendarexporter.h"
+#include "calendarstats.h"
+
+// Time in milliseconds spent applying batch operations before yielding to
+// the event loop
+static const int BatchBudget = 8;
 
 NemoCalendarApi::NemoCalendarApi(QObject *parent)
-: QObject(parent)
+: QObject(parent), mBatchIndex(0), mBatchFailures(0), mBatchEventSent(false)
 {
+    connect(&mAlarmTimer, SIGNAL(timeout()), this, SLOT(updateNextAlarm()));
+    connect(&mAlarmTimer, SIGNAL(clockChanged()), this, SLOT(updateNextAlarm()));
+    connect(NemoCalendarEventCache::instance(), SIGNAL(modelReset()), this, SLOT(updateNextAlarm()));
+
+    updateNextAlarm();
 }
 
 NemoCalendarEvent *NemoCalendarApi::createEvent()
@@ -50,17 +66,21 @@ NemoCalendarEvent *NemoCalendarApi::createEvent()
 
 void NemoCalendarApi::remove(const QString &uid)
 {
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
     mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
     KCalCore::Event::Ptr event = calendar->event(uid);
     if (!event)
         return;
     calendar->deleteEvent(event);
     // TODO: this sucks
-    NemoCalendarDb::storage()->save();
+    NemoCalendarDb::save();
 }
 
 void NemoCalendarApi::remove(const QString &uid, const QDateTime &time)
 {
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
     mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
     KCalCore::Event::Ptr event = calendar->event(uid);
     if (!event)
@@ -70,11 +90,354 @@ void NemoCalendarApi::remove(const QString &uid, const QDateTime &time)
     else
         calendar->deleteEvent(event);
     // TODO: this sucks
-    NemoCalendarDb::storage()->save();
+    NemoCalendarDb::save();
+}
+
+// Removes all events with the given uids
+void NemoCalendarApi::removeEvents(const QStringList &uids)
+{
+    QList<BatchOperation> batch;
+    for (int ii = 0; ii < uids.count(); ++ii) {
+        BatchOperation op;
+        op.type = BatchOperation::RemoveEvent;
+        op.uid = uids.at(ii);
+        batch.append(op);
+    }
+    queueBatch(batch);
+}
+
+// Removes occurrences given as objects with uniqueId and startTime
+// properties, as for remove(uid, time)
+void NemoCalendarApi::removeOccurrences(const QVariantList &occurrences)
+{
+    QList<BatchOperation> batch;
+    for (int ii = 0; ii < occurrences.count(); ++ii) {
+        QVariantMap map = occurrences.at(ii).toMap();
+        BatchOperation op;
+        op.type = BatchOperation::RemoveOccurrence;
+        op.uid = map.value("uniqueId").toString();
+        op.time = map.value("startTime").toDateTime();
+        batch.append(op);
+    }
+    queueBatch(batch);
+}
+
+// Moves the events with the given uids to another notebook.  Returns false
+// if the notebook does not exist or is read only.
+bool NemoCalendarApi::moveEvents(const QStringList &uids, const QString &notebookUid)
+{
+    if (!isWritableNotebook(notebookUid, "moveEvents"))
+        return false;
+
+    QList<BatchOperation> batch;
+    for (int ii = 0; ii < uids.count(); ++ii) {
+        BatchOperation op;
+        op.type = BatchOperation::MoveEvent;
+        op.uid = uids.at(ii);
+        op.notebook = notebookUid;
+        batch.append(op);
+    }
+    queueBatch(batch);
+    return true;
+}
+
+// Creates an event for each map of CalendarEvent property values, in
+// notebookUid or the default notebook.  Returns false if the notebook does
+// not exist or is read only.
+bool NemoCalendarApi::createEvents(const QVariantList &events, const QString &notebookUid)
+{
+    QString notebook = notebookUid.isEmpty()?NemoCalendarDb::storage()->defaultNotebook()->uid():notebookUid;
+    if (!isWritableNotebook(notebook, "createEvents"))
+        return false;
+
+    QList<BatchOperation> batch;
+    for (int ii = 0; ii < events.count(); ++ii) {
+        BatchOperation op;
+        op.type = BatchOperation::CreateEvent;
+        op.notebook = notebook;
+        op.properties = events.at(ii).toMap();
+        batch.append(op);
+    }
+    queueBatch(batch);
+    return true;
+}
+
+bool NemoCalendarApi::isWritableNotebook(const QString &notebookUid, const char *operation)
+{
+    mKCal::Notebook::Ptr notebook = NemoCalendarDb::storage()->notebook(notebookUid);
+    if (!notebook || notebook->isReadOnly()) {
+        qWarning("Calendar.%s: cannot write to notebook %s", operation, qPrintable(notebookUid));
+        return false;
+    }
+    return true;
+}
+
+// True while batch operations are pending.  The changes of all batches
+// queued while one is active are written in a single storage save, after
+// which batchFinished() is emitted and models are refreshed once.
+// batchFinished() reports failure if any operation could not be applied or
+// the save failed.
+bool NemoCalendarApi::batchActive() const
+{
+    return !mBatch.isEmpty();
+}
+
+// The time the next enabled alarm of any loaded event triggers.  Alarms
+// are only indexed once the storage is loaded, so a process still serving
+// the snapshot or the shared index loads it, and the property is updated
+// when that completes.
+QDateTime NemoCalendarApi::nextAlarm() const
+{
+    NemoCalendarEventCache::instance()->scheduleLoad();
+    return mNextAlarm;
+}
+
+// Returns the next count alarms to trigger as objects with uniqueId,
+// triggerTime and startTime properties.  startTime is only set for
+// alarms relative to the event start.
+QVariantList NemoCalendarApi::upcomingAlarms(int count)
+{
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
+    QList<NemoCalendarAlarmIndex::Alarm> alarms = NemoCalendarEventCache::instance()->mAlarmIndex.upcoming(count);
+
+    QVariantList rv;
+    for (int ii = 0; ii < alarms.count(); ++ii) {
+        QVariantMap map;
+        map.insert("uniqueId", alarms.at(ii).uid);
+        map.insert("triggerTime", alarms.at(ii).triggerTime);
+        map.insert("startTime", alarms.at(ii).startTime);
+        rv.append(map);
+    }
+    return rv;
+}
+
+void NemoCalendarApi::updateNextAlarm()
+{
+    QDateTime next = NemoCalendarEventCache::instance()->mAlarmIndex.next().triggerTime;
+
+    // The alarm is due once the clock passes its trigger time, so the timer
+    // is set just after it
+    if (next.isValid())
+        mAlarmTimer.start(next.addMSecs(1));
+    else
+        mAlarmTimer.stop();
+
+    if (next != mNextAlarm) {
+        mNextAlarm = next;
+        emit nextAlarmChanged();
+    }
+}
+
+void NemoCalendarApi::queueBatch(const QList<BatchOperation> &batch)
+{
+    if (batch.isEmpty())
+        return;
+
+    bool wasActive = batchActive();
+    mBatch += batch;
+
+    if (!mBatchEventSent) {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+        mBatchEventSent = true;
+    }
+
+    if (!wasActive)
+        emit batchActiveChanged();
+}
+
+bool NemoCalendarApi::event(QEvent *e)
+{
+    if (e->type() == QEvent::User) {
+        mBatchEventSent = false;
+        applyBatch();
+    }
+    return QObject::event(e);
+}
+
+// Applies queued operations to the calendar until the time budget runs
+// out, and saves once all of them have been applied.
+void NemoCalendarApi::applyBatch()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while (mBatchIndex < mBatch.count() && timer.elapsed() < BatchBudget) {
+        if (!apply(mBatch.at(mBatchIndex++)))
+            ++mBatchFailures;
+    }
+
+    emit batchProgress(mBatchIndex, mBatch.count());
+
+    if (mBatchIndex < mBatch.count()) {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+        mBatchEventSent = true;
+        return;
+    }
+
+    bool saved = NemoCalendarDb::save();
+    if (!saved)
+        qWarning("Calendar: cannot save batch of %d operations", mBatch.count());
+    else if (mBatchFailures)
+        qWarning("Calendar: %d of %d batch operations failed", mBatchFailures, mBatch.count());
+    bool success = saved && !mBatchFailures;
+
+    mBatch.clear();
+    mBatchIndex = 0;
+    mBatchFailures = 0;
+
+    emit batchActiveChanged();
+    emit batchFinished(success);
+
+    NemoCalendarEventCache::instance()->load();
+}
+
+// Returns false if the operation could not be applied
+bool NemoCalendarApi::apply(const BatchOperation &op)
+{
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+
+    if (op.type == BatchOperation::CreateEvent) {
+        NemoCalendarEvent event;
+        event.beginEdit();
+        for (QVariantMap::ConstIterator iter = op.properties.begin(); iter != op.properties.end(); ++iter) {
+            if (!event.setProperty(iter.key().toLatin1().constData(), iter.value()))
+                qWarning("Calendar.createEvents: cannot set property %s", qPrintable(iter.key()));
+        }
+        event.commitEdit();
+        if (!calendar->addEvent(event.event(), op.notebook)) {
+            qWarning("Calendar.createEvents: cannot add event to notebook %s", qPrintable(op.notebook));
+            return false;
+        }
+        return true;
+    }
+
+    KCalCore::Event::Ptr event = calendar->event(op.uid);
+    if (!event)
+        return true;
+
+    switch (op.type) {
+    case BatchOperation::RemoveEvent:
+        if (!calendar->deleteEvent(event)) {
+            qWarning("Calendar.removeEvents: cannot remove event %s", qPrintable(op.uid));
+            return false;
+        }
+        break;
+    case BatchOperation::RemoveOccurrence:
+        if (event->recurs()) {
+            event->recurrence()->addExDateTime(KDateTime(op.time, KDateTime::Spec(KDateTime::LocalZone)));
+        } else if (!calendar->deleteEvent(event)) {
+            qWarning("Calendar.removeOccurrences: cannot remove event %s", qPrintable(op.uid));
+            return false;
+        }
+        break;
+    case BatchOperation::MoveEvent:
+        if (calendar->notebook(event) != op.notebook) {
+            if (!calendar->setNotebook(event, op.notebook)) {
+                qWarning("Calendar.moveEvents: cannot move event %s to notebook %s",
+                         qPrintable(op.uid), qPrintable(op.notebook));
+                return false;
+            }
+            // Marks the incidence as modified so the storage rewrites it
+            event->setRevision(event->revision() + 1);
+        }
+        break;
+    case BatchOperation::CreateEvent:
+        break;
+    }
+
+    return true;
+}
+
+// Imports the events of an iCalendar file into notebookUid, or the default
+// notebook.  The file is read and saved in batches from the event loop;
+// events whose uid already exists in the calendar, and events that cannot
+// be added, are skipped.  Returns false if the notebook does not exist or is
+// read only or the file cannot be opened, otherwise importFinished() is
+// emitted once the import completes.
+bool NemoCalendarApi::importFile(const QString &fileName, const QString &notebookUid)
+{
+    QUrl url(fileName);
+    NemoCalendarImporter *importer = new NemoCalendarImporter(url.isLocalFile()?url.toLocalFile():fileName,
+                                                              notebookUid, this);
+    connect(importer, SIGNAL(progress(qint64,qint64)), this, SIGNAL(importProgress(qint64,qint64)));
+    connect(importer, SIGNAL(finished(int,int,bool)), this, SLOT(importerFinished(int,int,bool)));
+
+    if (!importer->start()) {
+        delete importer;
+        return false;
+    }
+
+    return true;
+}
+
+void NemoCalendarApi::importerFinished(int imported, int skipped, bool success)
+{
+    sender()->deleteLater();
+
+    if (imported)
+        NemoCalendarEventCache::instance()->load();
+
+    emit importFinished(imported, skipped, success);
+}
+
+// Writes all events of a notebook to a file.  The events are copied and
+// serialized on a separate thread; exportFinished() is emitted when done.
+bool NemoCalendarApi::exportNotebook(const QString &fileName, const QString &notebookUid, ExportFormat format)
+{
+    NemoCalendarExporter *exporter = startExport(fileName, format);
+    if (!exporter)
+        return false;
+
+    exporter->addNotebook(notebookUid);
+    exporter->start();
+    return true;
+}
+
+// Writes all events occurring between start and end inclusive to a file
+bool NemoCalendarApi::exportRange(const QString &fileName, const QDate &start, const QDate &end, ExportFormat format)
+{
+    NemoCalendarExporter *exporter = startExport(fileName, format);
+    if (!exporter)
+        return false;
+
+    exporter->addRange(start, end);
+    exporter->start();
+    return true;
+}
+
+NemoCalendarExporter *NemoCalendarApi::startExport(const QString &fileName, ExportFormat format)
+{
+    QUrl url(fileName);
+    QFile *file = new QFile(url.isLocalFile()?url.toLocalFile():fileName);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        delete file;
+        return 0;
+    }
+
+    NemoCalendarExporter *exporter =
+        new NemoCalendarExporter(file, format == VCalendarFormat?NemoCalendarExporter::VCalendar
+                                                                :NemoCalendarExporter::ICalendar, this);
+    file->setParent(exporter);
+    exporter->setObjectName(fileName);
+    connect(exporter, SIGNAL(finished()), this, SLOT(exporterFinished()));
+    return exporter;
+}
+
+void NemoCalendarApi::exporterFinished()
+{
+    NemoCalendarExporter *exporter = static_cast<NemoCalendarExporter *>(sender());
+    emit exportFinished(exporter->objectName(), exporter->count(), exporter->success());
+    exporter->deleteLater();
 }
 
 QStringList NemoCalendarApi::excludedNotebooks() const
 {
+    // Only notebooks with occurrences near today are known before loading
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
     mKCal::Notebook::List notebooks = NemoCalendarDb::storage()->notebooks();
 
     QStringList rv;
@@ -111,6 +474,11 @@ void NemoCalendarApi::setExcludedNotebooks(const QStringList &list)
     NemoCalendarEventCache::instance()->load();
 }
 
+NemoCalendarStats *NemoCalendarApi::stats() const
+{
+    return NemoCalendarStats::instance();
+}
+
 QObject *NemoCalendarApi::New(QQmlEngine *e, QJSEngine *)
 {
     return new NemoCalendarApi(e);
@@ -33,33 +33,110 @@
 #ifndef CALENDARAPI_H
 #define CALENDARAPI_H
 
+#include <QDateTime>
 #include <QStringList>
+#include <QVariantList>
 #include <QAbstractListModel>
 
+#include "calendarclocktimer.h"
+
 class QJSEngine;
 class QQmlEngine;
 class NemoCalendarEvent;
+class NemoCalendarExporter;
+class NemoCalendarStats;
 
 class NemoCalendarApi : public QObject
 {
     Q_OBJECT
+    Q_ENUMS(ExportFormat)
     Q_PROPERTY(QStringList excludedNotebooks READ excludedNotebooks WRITE setExcludedNotebooks NOTIFY excludedNotebooksChanged)
+    Q_PROPERTY(bool batchActive READ batchActive NOTIFY batchActiveChanged)
+    Q_PROPERTY(QDateTime nextAlarm READ nextAlarm NOTIFY nextAlarmChanged)
+    Q_PROPERTY(NemoCalendarStats *stats READ stats CONSTANT)
 
 public:
+    enum ExportFormat {
+        ICalendarFormat,
+        VCalendarFormat
+    };
+
     NemoCalendarApi(QObject *parent = 0);
 
     Q_INVOKABLE NemoCalendarEvent *createEvent();
     Q_INVOKABLE void remove(const QString &);
     Q_INVOKABLE void remove(const QString &, const QDateTime &);
 
+    Q_INVOKABLE void removeEvents(const QStringList &);
+    Q_INVOKABLE void removeOccurrences(const QVariantList &);
+    Q_INVOKABLE bool moveEvents(const QStringList &, const QString &notebookUid);
+    Q_INVOKABLE bool createEvents(const QVariantList &, const QString &notebookUid = QString());
+
+    bool batchActive() const;
+
+    QDateTime nextAlarm() const;
+    Q_INVOKABLE QVariantList upcomingAlarms(int count);
+
+    Q_INVOKABLE bool importFile(const QString &fileName, const QString &notebookUid = QString());
+    Q_INVOKABLE bool exportNotebook(const QString &fileName, const QString &notebookUid,
+                                    ExportFormat format = ICalendarFormat);
+    Q_INVOKABLE bool exportRange(const QString &fileName, const QDate &start, const QDate &end,
+                                 ExportFormat format = ICalendarFormat);
+
     QStringList excludedNotebooks() const;
     void setExcludedNotebooks(const QStringList &);
 
+    NemoCalendarStats *stats() const;
+
     static QObject *New(QQmlEngine *, QJSEngine *);
 
 signals:
     void excludedNotebooksChanged();
+    void batchActiveChanged();
+    void batchProgress(int completed, int total);
+    void batchFinished(bool success);
+    void nextAlarmChanged();
+    void importProgress(qint64 bytesRead, qint64 bytesTotal);
+    void importFinished(int imported, int skipped, bool success);
+    void exportFinished(const QString &fileName, int exported, bool success);
+
+protected:
+    virtual bool event(QEvent *);
+
+private slots:
+    void importerFinished(int imported, int skipped, bool success);
+    void exporterFinished();
+    void updateNextAlarm();
+
+private:
+    struct BatchOperation {
+        enum Type {
+            RemoveEvent,
+            RemoveOccurrence,
+            MoveEvent,
+            CreateEvent
+        };
+
+        Type type;
+        QString uid;
+        QDateTime time;
+        QString notebook;
+        QVariantMap properties;
+    };
+
+    void queueBatch(const QList<BatchOperation> &);
+    void applyBatch();
+    bool apply(const BatchOperation &);
+    static bool isWritableNotebook(const QString &notebookUid, const char *operation);
+    NemoCalendarExporter *startExport(const QString &fileName, ExportFormat format);
+
+    QList<BatchOperation> mBatch;
+    int mBatchIndex;
+    int mBatchFailures;
+    bool mBatchEventSent;
 
+    QDateTime mNextAlarm;
+    NemoCalendarClockTimer mAlarmTimer;
 };
 
 #endif // CALENDARAPI_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarclocktimer.h"
+
+#include <QSocketNotifier>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "calendareventcache.h"
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+NemoCalendarClockTimer::NemoCalendarClockTimer(QObject *parent)
+: QObject(parent), mNotifier(0)
+{
+    mFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (mFd != -1) {
+        mNotifier = new QSocketNotifier(mFd, QSocketNotifier::Read, this);
+        connect(mNotifier, SIGNAL(activated(int)), this, SLOT(timerActivated()));
+    } else {
+        qWarning("NemoCalendarClockTimer: no timerfd, falling back to QTimer");
+    }
+
+    mFallbackTimer.setSingleShot(true);
+    mFallbackTimer.setTimerType(Qt::PreciseTimer);
+    connect(&mFallbackTimer, SIGNAL(timeout()), this, SLOT(fallbackTimeout()));
+
+    // The cache watches the zone file on behalf of every timer
+    connect(NemoCalendarEventCache::instance(), SIGNAL(timeZoneChanged()), this, SLOT(timeZoneChanged()));
+}
+
+NemoCalendarClockTimer::~NemoCalendarClockTimer()
+{
+    if (mFd != -1) {
+        delete mNotifier;
+        close(mFd);
+    }
+}
+
+// Fires timeout() once time is reached.  A time already passed fires on the
+// next return to the event loop.
+void NemoCalendarClockTimer::start(const QDateTime &time)
+{
+    mTime = time;
+    arm();
+}
+
+void NemoCalendarClockTimer::stop()
+{
+    mTime = QDateTime();
+    arm();
+}
+
+void NemoCalendarClockTimer::arm()
+{
+    if (mFd == -1) {
+        mFallbackTimer.stop();
+        if (mTime.isValid()) {
+            // Anything beyond a day is rechecked after a day, which also
+            // bounds how far a clock change can throw the timer out
+            qint64 msecs = qBound<qint64>(0, QDateTime::currentDateTime().msecsTo(mTime), 24 * 60 * 60 * 1000);
+            mFallbackTimer.start(int(msecs));
+        }
+        return;
+    }
+
+    // An absolute time on CLOCK_REALTIME follows clock changes by itself;
+    // cancel on set reports them so callers can work out times again
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 0;
+    if (mTime.isValid()) {
+        qint64 msecs = qMax<qint64>(1, mTime.toMSecsSinceEpoch());
+        spec.it_value.tv_sec = msecs / 1000;
+        spec.it_value.tv_nsec = (msecs % 1000) * 1000000;
+    }
+
+    if (timerfd_settime(mFd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, 0) == -1)
+        qWarning("NemoCalendarClockTimer: unable to arm timer: %s", strerror(errno));
+}
+
+void NemoCalendarClockTimer::timerActivated()
+{
+    quint64 expirations;
+    ssize_t size = read(mFd, &expirations, sizeof(expirations));
+    if (size == sizeof(expirations)) {
+        mTime = QDateTime();
+        emit timeout();
+    } else if (size == -1 && errno == ECANCELED) {
+        // The clock was set.  Keep the timer going for the same time until
+        // the caller decides otherwise.
+        arm();
+        emit clockChanged();
+    }
+}
+
+void NemoCalendarClockTimer::fallbackTimeout()
+{
+    if (mTime.isValid() && QDateTime::currentDateTime() < mTime) {
+        arm();
+        return;
+    }
+
+    mTime = QDateTime();
+    emit timeout();
+}
+
+void NemoCalendarClockTimer::timeZoneChanged()
+{
+    if (mFd == -1)
+        arm();
+    emit clockChanged();
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARCLOCKTIMER_H
+#define CALENDARCLOCKTIMER_H
+
+#include <QTimer>
+#include <QObject>
+#include <QDateTime>
+
+class QSocketNotifier;
+
+// A single shot timer for a wall clock time.  Where timerfd is available it
+// runs on CLOCK_REALTIME, so it fires on time after the device was
+// suspended and when the system clock is set past it; otherwise a precise
+// QTimer, re-armed at least daily, is used.  clockChanged() is emitted when
+// the system clock is set or the local time zone changes, as times worked
+// out from the old clock may no longer be right.
+//
+// Only to be used from the GUI thread.
+class NemoCalendarClockTimer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit NemoCalendarClockTimer(QObject *parent = 0);
+    virtual ~NemoCalendarClockTimer();
+
+    void start(const QDateTime &time);
+    void stop();
+
+signals:
+    void timeout();
+    void clockChanged();
+
+private slots:
+    void timerActivated();
+    void fallbackTimeout();
+    void timeZoneChanged();
+
+private:
+    void arm();
+
+    int mFd;
+    QSocketNotifier *mNotifier;
+    QTimer mFallbackTimer;
+    QDateTime mTime;
+};
+
+#endif // CALENDARCLOCKTIMER_H
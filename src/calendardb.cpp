@@ -31,6 +31,7 @@
  */
 
 #include "calendardb.h"
+#include "calendarstats.h"
 
 #include <notebook.h>
 #include <QDebug>
@@ -55,3 +56,11 @@ mKCal::ExtendedStorage::Ptr &NemoCalendarDb::storage()
 
     return ptr;
 }
+
+bool NemoCalendarDb::save()
+{
+    NemoCalendarTrace trace(NemoCalendarStats::SaveStage);
+    NemoCalendarStats::count(NemoCalendarStats::SavesIssued);
+
+    return storage()->save();
+}
@@ -41,6 +41,8 @@ class NemoCalendarDb
 public:
     static mKCal::ExtendedCalendar::Ptr &calendar();
     static mKCal::ExtendedStorage::Ptr &storage();
+
+    static bool save();
 };
 
 #endif // CALENDARDB_H
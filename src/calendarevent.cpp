@@ -41,26 +41,29 @@
 
 #include "calendardb.h"
 #include "calendareventcache.h"
-
-#include <vcalformat.h>
-#include <libical/vobject.h>
-#include <libical/vcaltmp.h>
+#include "calendarvcalwriter.h"
+#include "calendarlocalzone.h"
 
 NemoCalendarEvent::NemoCalendarEvent(QObject *parent)
-: QObject(parent), mNewEvent(true), mEvent(KCalCore::Event::Ptr(new KCalCore::Event))
+: QObject(parent), mNewEvent(true), mEvent(KCalCore::Event::Ptr(new KCalCore::Event)),
+  mEditDepth(0), mPendingChanges(0)
 {
     NemoCalendarEventCache::instance()->mEvents.insert(this);
 }
 
 NemoCalendarEvent::NemoCalendarEvent(const KCalCore::Event::Ptr &event, QObject *parent)
-: QObject(parent), mNewEvent(false), mEvent(event)
+: QObject(parent), mNewEvent(false), mEvent(event), mEditDepth(0), mPendingChanges(0)
 {
     NemoCalendarEventCache::instance()->mEvents.insert(this);
 }
 
 NemoCalendarEvent::~NemoCalendarEvent()
 {
+    if (mEditEvent)
+        mEditEvent->endUpdates();
+
     NemoCalendarEventCache::instance()->mEvents.remove(this);
+    NemoCalendarEventCache::instance()->mRebindChanges.remove(this);
 }
 
 QString NemoCalendarEvent::displayLabel() const
@@ -70,61 +73,66 @@ QString NemoCalendarEvent::displayLabel() const
 
 void NemoCalendarEvent::setDisplayLabel(const QString &displayLabel)
 {
+    ensureLoaded();
+
     if (!mEvent || mEvent->summary() == displayLabel)
         return;
 
     mEvent->setSummary(displayLabel);
 
-    foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-        emit event->displayLabelChanged();
+    notifyChanged(DisplayLabelChange);
 }
 
 QString NemoCalendarEvent::description() const
 {
+    ensureLoaded();
     return mEvent?mEvent->description():QString();
 }
 
 void NemoCalendarEvent::setDescription(const QString &description)
 {
+    ensureLoaded();
+
     if (!mEvent || mEvent->description() == description)
         return;
 
     mEvent->setDescription(description);
 
-    foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-        emit event->descriptionChanged();
+    notifyChanged(DescriptionChange);
 }
 
 QDateTime NemoCalendarEvent::startTime() const
 {
-    return mEvent?mEvent->dtStart().toLocalZone().dateTime():QDateTime();
+    return mEvent?NemoCalendarLocalZone::toLocal(mEvent->dtStart()):QDateTime();
 }
 
 void NemoCalendarEvent::setStartTime(const QDateTime &startTime)
 {
-    if (!mEvent || mEvent->dtStart().toLocalZone().dateTime() == startTime)
+    ensureLoaded();
+
+    if (!mEvent || NemoCalendarLocalZone::toLocal(mEvent->dtStart()) == startTime)
         return;
 
     mEvent->setDtStart(KDateTime(startTime, KDateTime::Spec(KDateTime::LocalZone)));
 
-    foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-        emit event->startTimeChanged();
+    notifyChanged(StartTimeChange);
 }
 
 QDateTime NemoCalendarEvent::endTime() const
 {
-    return mEvent?mEvent->dtEnd().toLocalZone().dateTime():QDateTime();
+    return mEvent?NemoCalendarLocalZone::toLocal(mEvent->dtEnd()):QDateTime();
 }
 
 void NemoCalendarEvent::setEndTime(const QDateTime &endTime)
 {
-    if (!mEvent || mEvent->dtEnd().toLocalZone().dateTime() == endTime)
+    ensureLoaded();
+
+    if (!mEvent || NemoCalendarLocalZone::toLocal(mEvent->dtEnd()) == endTime)
         return;
 
     mEvent->setDtEnd(KDateTime(endTime, KDateTime::Spec(KDateTime::LocalZone)));
 
-    foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-        emit event->endTimeChanged();
+    notifyChanged(EndTimeChange);
 }
 
 bool NemoCalendarEvent::allDay() const
@@ -134,17 +142,20 @@ bool NemoCalendarEvent::allDay() const
 
 void NemoCalendarEvent::setAllDay(bool a)
 {
+    ensureLoaded();
+
     if (!mEvent || allDay() == a)
         return;
 
     mEvent->setAllDay(a);
 
-    foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-        emit event->allDayChanged();
+    notifyChanged(AllDayChange);
 }
 
 NemoCalendarEvent::Recur NemoCalendarEvent::recur() const
 {
+    ensureLoaded();
+
     if (mEvent && mEvent->recurs()) {
         if (mEvent->recurrence()->rRules().count() != 1) {
             return RecurCustom;
@@ -173,6 +184,8 @@ NemoCalendarEvent::Recur NemoCalendarEvent::recur() const
 
 void NemoCalendarEvent::setRecur(Recur r)
 {
+    ensureLoaded();
+
     if (!mEvent)
         return;
 
@@ -210,42 +223,43 @@ void NemoCalendarEvent::setRecur(Recur r)
                 break;
         }
 
-        foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-            emit event->recurChanged();
+        notifyChanged(RecurChange);
     }
 
-    if (recurExceptions() != oldExceptions) {
-        foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-            emit event->recurExceptionsChanged();
-    }
+    if (recurExceptions() != oldExceptions)
+        notifyChanged(RecurExceptionsChange);
 }
 
 int NemoCalendarEvent::recurExceptions() const
 {
-    return mEvent->recurs()?mEvent->recurrence()->exDateTimes().count():0;
+    ensureLoaded();
+    return exceptions().count();
 }
 
+// The exception dates are kept sorted and unique by the recurrence, so
+// lookups are binary searches and edits never need to re-sort the list
 void NemoCalendarEvent::removeException(int index)
 {
-    if (mEvent->recurs()) {
-        KCalCore::DateTimeList list = mEvent->recurrence()->exDateTimes();
-        if (list.count() > index) {
-            list.removeAt(index);
-            mEvent->recurrence()->setExDateTimes(list);
-            foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-                emit event->recurExceptionsChanged();
-        }
+    ensureLoaded();
+
+    KCalCore::DateTimeList list = exceptions();
+    if (index >= 0 && list.count() > index) {
+        list.removeAt(index);
+        setExceptionList(list);
     }
 }
 
 void NemoCalendarEvent::addException(const QDateTime &date)
 {
+    ensureLoaded();
+
     if (mEvent->recurs()) {
-        KCalCore::DateTimeList list = mEvent->recurrence()->exDateTimes();
-        list.append(KDateTime(date, KDateTime::Spec(KDateTime::LocalZone)));
-        mEvent->recurrence()->setExDateTimes(list);
-        foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-            emit event->recurExceptionsChanged();
+        KDateTime exception(date, KDateTime::Spec(KDateTime::LocalZone));
+        if (mEvent->recurrence()->exDateTimes().containsSorted(exception))
+            return;
+
+        mEvent->recurrence()->addExDateTime(exception);
+        notifyChanged(RecurExceptionsChange);
     } else {
         qmlInfo(this) << "Cannot add exception to non-recurring event";
     }
@@ -253,16 +267,111 @@ void NemoCalendarEvent::addException(const QDateTime &date)
 
 QDateTime NemoCalendarEvent::recurException(int index) const
 {
-    if (mEvent->recurs()) {
-        KCalCore::DateTimeList list = mEvent->recurrence()->exDateTimes();
-        if (list.count() > index)
-            return list.at(index).toLocalZone().dateTime();
-    }
+    ensureLoaded();
+    KCalCore::DateTimeList list = exceptions();
+    if (index >= 0 && list.count() > index)
+        return NemoCalendarLocalZone::toLocal(list.at(index));
     return QDateTime();
 }
 
+bool NemoCalendarEvent::hasException(const QDateTime &date) const
+{
+    ensureLoaded();
+    return exceptions().containsSorted(KDateTime(date, KDateTime::Spec(KDateTime::LocalZone)));
+}
+
+QVariantList NemoCalendarEvent::recurExceptionDates() const
+{
+    ensureLoaded();
+
+    KCalCore::DateTimeList list = exceptions();
+
+    QVariantList rv;
+    rv.reserve(list.count());
+    for (int ii = 0; ii < list.count(); ++ii)
+        rv.append(NemoCalendarLocalZone::toLocal(list.at(ii)));
+    return rv;
+}
+
+// Replaces all exception dates with dates
+void NemoCalendarEvent::setExceptions(const QVariantList &dates)
+{
+    ensureLoaded();
+
+    if (!mEvent->recurs()) {
+        if (!dates.isEmpty())
+            qmlInfo(this) << "Cannot add exception to non-recurring event";
+        return;
+    }
+
+    setExceptionList(toExceptionList(dates));
+}
+
+// Adds dates to the exception dates, ignoring any already present
+void NemoCalendarEvent::addExceptions(const QVariantList &dates)
+{
+    ensureLoaded();
+
+    if (!mEvent->recurs()) {
+        qmlInfo(this) << "Cannot add exception to non-recurring event";
+        return;
+    }
+
+    KCalCore::DateTimeList current = exceptions();
+    KCalCore::DateTimeList added = toExceptionList(dates);
+
+    // Merge the two sorted lists rather than inserting one date at a time
+    KCalCore::DateTimeList list;
+    list.reserve(current.count() + added.count());
+    int ii = 0;
+    int jj = 0;
+    while (ii < current.count() || jj < added.count()) {
+        if (jj == added.count() || (ii < current.count() && current.at(ii) < added.at(jj))) {
+            list.append(current.at(ii++));
+        } else if (ii == current.count() || added.at(jj) < current.at(ii)) {
+            list.append(added.at(jj++));
+        } else {
+            list.append(current.at(ii++));
+            ++jj;
+        }
+    }
+
+    if (list.count() != current.count())
+        setExceptionList(list);
+}
+
+KCalCore::DateTimeList NemoCalendarEvent::exceptions() const
+{
+    return (mEvent && mEvent->recurs())?mEvent->recurrence()->exDateTimes():KCalCore::DateTimeList();
+}
+
+// Converts dates to a sorted list without duplicates
+KCalCore::DateTimeList NemoCalendarEvent::toExceptionList(const QVariantList &dates)
+{
+    KCalCore::DateTimeList list;
+    list.reserve(dates.count());
+    for (int ii = 0; ii < dates.count(); ++ii) {
+        QDateTime date = dates.at(ii).toDateTime();
+        if (date.isValid())
+            list.append(KDateTime(date, KDateTime::Spec(KDateTime::LocalZone)));
+    }
+    list.sortUnique();
+    return list;
+}
+
+void NemoCalendarEvent::setExceptionList(const KCalCore::DateTimeList &list)
+{
+    if (list == exceptions())
+        return;
+
+    mEvent->recurrence()->setExDateTimes(list);
+    notifyChanged(RecurExceptionsChange);
+}
+
 NemoCalendarEvent::Reminder NemoCalendarEvent::reminder() const
 {
+    ensureLoaded();
+
     KCalCore::Alarm::List alarms = mEvent->alarms();
 
     KCalCore::Alarm::Ptr alarm;
@@ -307,6 +416,8 @@ NemoCalendarEvent::Reminder NemoCalendarEvent::reminder() const
 
 void NemoCalendarEvent::setReminder(Reminder r)
 {
+    ensureLoaded();
+
     Reminder old = reminder();
 
     KCalCore::Alarm::List alarms = mEvent->alarms();
@@ -353,10 +464,8 @@ void NemoCalendarEvent::setReminder(Reminder r)
         alarm->setStartOffset(offset);
     }
 
-    if (r != old) {
-        foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-            emit event->reminderChanged();
-    }
+    if (r != old)
+        notifyChanged(ReminderChange);
 }
 
 QString NemoCalendarEvent::uniqueId() const
@@ -366,12 +475,14 @@ QString NemoCalendarEvent::uniqueId() const
 
 QString NemoCalendarEvent::color() const
 {
-    QString eventNotebook = NemoCalendarDb::calendar()->notebook(mEvent);
-    return NemoCalendarEventCache::instance()->notebookColor(eventNotebook);
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    return cache->notebookColor(cache->notebook(mEvent));
 }
 
 QString NemoCalendarEvent::alarmProgram() const
 {
+    ensureLoaded();
+
     KCalCore::Alarm::List alarms = mEvent->alarms();
 
     for (int ii = 0; ii < alarms.count(); ++ii) {
@@ -385,6 +496,8 @@ QString NemoCalendarEvent::alarmProgram() const
 
 void NemoCalendarEvent::setAlarmProgram(const QString &program)
 {
+    ensureLoaded();
+
     KCalCore::Alarm::List alarms = mEvent->alarms();
 
     for (int ii = 0; ii < alarms.count(); ++ii) {
@@ -393,8 +506,7 @@ void NemoCalendarEvent::setAlarmProgram(const QString &program)
 
             if (alarms.at(ii)->programFile() != program) {
                 alarms[ii]->setProgramFile(program);
-                foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
-                    emit event->alarmProgramChanged();
+                notifyChanged(AlarmProgramChange);
             }
 
             return;
@@ -409,12 +521,16 @@ void NemoCalendarEvent::setAlarmProgram(const QString &program)
 
 bool NemoCalendarEvent::readonly() const
 {
+    ensureLoaded();
+
     QString eventNotebook = NemoCalendarDb::calendar()->notebook(mEvent);
     return eventNotebook != NemoCalendarDb::storage()->defaultNotebook()->uid();
 }
 
 void NemoCalendarEvent::save()
 {
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
     if (mNewEvent) {
         mNewEvent = false;
         NemoCalendarDb::calendar()->addEvent(mEvent, NemoCalendarDb::storage()->defaultNotebook()->uid());
@@ -423,57 +539,132 @@ void NemoCalendarEvent::save()
     mEvent->setRevision(mEvent->revision() + 1);
 
     // TODO: this sucks
-    NemoCalendarDb::storage()->save();
+    NemoCalendarDb::save();
+}
+
+// Starts a group of changes.  Change signals are held back until the
+// matching commitEdit(), when each is emitted once to every wrapper of the
+// event, and the incidence notifies its observers once.  Transactions may
+// nest.
+void NemoCalendarEvent::beginEdit()
+{
+    ensureLoaded();
+
+    if (mEditDepth++ == 0 && mEvent) {
+        mEditEvent = mEvent;
+        mEditEvent->startUpdates();
+    }
+}
+
+// Ends a group of changes started with beginEdit(), saving the event if
+// save is true
+void NemoCalendarEvent::commitEdit(bool save)
+{
+    if (mEditDepth == 0) {
+        qmlInfo(this) << "commitEdit() called without beginEdit()";
+        return;
+    }
+
+    if (--mEditDepth > 0)
+        return;
+
+    int changes = mPendingChanges;
+    mPendingChanges = 0;
+
+    // The storage learns of the changes from the incidence's observers, so
+    // they are released before saving
+    if (mEditEvent) {
+        mEditEvent->endUpdates();
+        mEditEvent.clear();
+    }
+
+    if (save)
+        this->save();
+
+    if (changes)
+        notifyChanged(changes);
+}
+
+void NemoCalendarEvent::notifyChanged(int changes)
+{
+    if (mEditDepth > 0) {
+        mPendingChanges |= changes;
+        return;
+    }
+
+    foreach(NemoCalendarEvent *event, NemoCalendarEventCache::events(mEvent))
+        event->emitChanged(changes);
+}
+
+void NemoCalendarEvent::emitChanged(int changes)
+{
+    if (changes & DisplayLabelChange) emit displayLabelChanged();
+    if (changes & DescriptionChange) emit descriptionChanged();
+    if (changes & StartTimeChange) emit startTimeChanged();
+    if (changes & EndTimeChange) emit endTimeChanged();
+    if (changes & AllDayChange) emit allDayChanged();
+    if (changes & RecurChange) emit recurChanged();
+    if (changes & RecurExceptionsChange) emit recurExceptionsChanged();
+    if (changes & ReminderChange) emit reminderChanged();
+    if (changes & AlarmProgramChange) emit alarmProgramChanged();
 }
 
 // Removes the entire event
 void NemoCalendarEvent::remove()
 {
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
     if (!mNewEvent) {
         NemoCalendarDb::calendar()->deleteEvent(mEvent);
 
         // TODO: this sucks
-        NemoCalendarDb::storage()->save();
+        NemoCalendarDb::save();
     }
 }
 
-// eventToVEvent() is protected
-class NemoCalendarVCalFormat : public KCalCore::VCalFormat
-{
-public:
-    QString convertEventToVEvent(const KCalCore::Event::Ptr &event, const QString &prodId)
-    {
-        VObject *vCalObj = vcsCreateVCal(
-            QDateTime::currentDateTime().toString(Qt::ISODate).toLatin1().data(),
-            NULL,
-            prodId.toLatin1().data(),
-            NULL,
-            "1.0");
-        VObject *vEventObj = eventToVEvent(event);
-        addVObjectProp(vCalObj, vEventObj);
-        char *memVObject = writeMemVObject(0, 0, vCalObj);
-        QString retn = QLatin1String(memVObject);
-        free(memVObject);
-        free(vEventObj);
-        free(vCalObj);
-        return retn;
-    }
-};
-
 // Returns the event as a VCalendar string
 QString NemoCalendarEvent::vCalendar(const QString &prodId) const
 {
-    NemoCalendarVCalFormat fmt;
-    return fmt.convertEventToVEvent(mEvent,
-            prodId.isEmpty() ?
-            QLatin1String("-//NemoMobile.org/Nemo//NONSGML v1.0//EN") :
-            prodId);
+    ensureLoaded();
+
+    QString id = prodId.isEmpty()?QLatin1String("-//NemoMobile.org/Nemo//NONSGML v1.0//EN"):prodId;
+    QDateTime created = QDateTime::currentDateTime();
+
+    if (!NemoCalendarVCalWriter::canWrite(mEvent))
+        return QString::fromUtf8(NemoCalendarVCalWriter::referenceVCalendar(mEvent, id, created));
+
+    return QString::fromUtf8(NemoCalendarVCalWriter::vCalendar(mEvent, id, created));
 }
 
 void NemoCalendarEvent::setEvent(const KCalCore::Event::Ptr &event)
+{
+    emitChanged(rebind(event));
+}
+
+// Agenda rows served from the snapshot before the storage is loaded hold
+// placeholder events carrying only the summary, times and notebook, which
+// are read only.  Anything else is read from, and changes are made to, the
+// real event, so the storage is loaded first.
+void NemoCalendarEvent::ensureLoaded() const
+{
+    if (!mNewEvent)
+        NemoCalendarEventCache::instance()->ensureEventLoaded();
+}
+
+// Points the wrapper at event, returning the changes to be notified
+int NemoCalendarEvent::rebind(const KCalCore::Event::Ptr &event)
 {
     if (mEvent == event)
-        return;
+        return 0;
+
+    // Storage bumps the revision and modification time on every save, so a
+    // matching stamp means the new incidence holds the same data
+    if (mEvent && event && mEvent->uid() == event->uid() &&
+        mEvent->revision() == event->revision() && mEvent->lastModified() == event->lastModified() &&
+        mEvent->lastModified().isValid()) {
+        mEvent = event;
+        return 0;
+    }
 
     QString dl = displayLabel();
     QString de = description();
@@ -481,15 +672,23 @@ void NemoCalendarEvent::setEvent(const KCalCore::Event::Ptr &event)
     QDateTime et = endTime();
     bool ad = allDay();
     Recur re = recur();
+    KCalCore::DateTimeList ex = exceptions();
+    Reminder rm = mEvent?reminder():ReminderNone;
+    QString ap = mEvent?alarmProgram():QString();
 
     mEvent = event;
 
-    if (displayLabel() != dl) emit displayLabelChanged();
-    if (description() != de) emit descriptionChanged();
-    if (startTime() != st) emit startTimeChanged();
-    if (endTime() != et) emit endTimeChanged();
-    if (allDay() != ad) emit allDayChanged();
-    if (recur() != re) emit recurChanged();
+    int changes = 0;
+    if (displayLabel() != dl) changes |= DisplayLabelChange;
+    if (description() != de) changes |= DescriptionChange;
+    if (startTime() != st) changes |= StartTimeChange;
+    if (endTime() != et) changes |= EndTimeChange;
+    if (allDay() != ad) changes |= AllDayChange;
+    if (recur() != re) changes |= RecurChange;
+    if (exceptions() != ex) changes |= RecurExceptionsChange;
+    if ((mEvent?reminder():ReminderNone) != rm) changes |= ReminderChange;
+    if ((mEvent?alarmProgram():QString()) != ap) changes |= AlarmProgramChange;
+    return changes;
 }
 
 NemoCalendarEventOccurrence::NemoCalendarEventOccurrence(const mKCal::ExtendedCalendar::ExpandedIncidence &o,
@@ -530,6 +729,10 @@ void NemoCalendarEventOccurrence::setEvent(const KCalCore::Event::Ptr &event)
 // this instance
 void NemoCalendarEventOccurrence::remove()
 {
+    NemoCalendarEventCache::instance()->ensureLoaded();
+    if (!mOccurrence.second)
+        return;
+
     if (mOccurrence.second->recurs()) {
         mOccurrence.second->recurrence()->addExDateTime(KDateTime(mOccurrence.first.dtStart,
                                                                   KDateTime::Spec(KDateTime::LocalZone)));
@@ -538,6 +741,6 @@ void NemoCalendarEventOccurrence::remove()
     }
 
     // TODO: this sucks
-    NemoCalendarDb::storage()->save();
+    NemoCalendarDb::save();
 }
 
@@ -35,6 +35,7 @@
 
 #include <QObject>
 #include <QDateTime>
+#include <QVariantList>
 
 // mkcal
 #include <event.h>
@@ -53,6 +54,7 @@ class NemoCalendarEvent : public QObject
     Q_PROPERTY(bool allDay READ allDay WRITE setAllDay NOTIFY allDayChanged)
     Q_PROPERTY(Recur recur READ recur WRITE setRecur NOTIFY recurChanged)
     Q_PROPERTY(int recurExceptions READ recurExceptions NOTIFY recurExceptionsChanged)
+    Q_PROPERTY(QVariantList recurExceptionDates READ recurExceptionDates WRITE setExceptions NOTIFY recurExceptionsChanged)
     Q_PROPERTY(Reminder reminder READ reminder WRITE setReminder NOTIFY reminderChanged)
     Q_PROPERTY(QString uniqueId READ uniqueId CONSTANT)
     Q_PROPERTY(QString color READ color NOTIFY colorChanged)
@@ -108,6 +110,11 @@ public:
     Q_INVOKABLE void removeException(int);
     Q_INVOKABLE void addException(const QDateTime &);
     Q_INVOKABLE QDateTime recurException(int) const;
+    Q_INVOKABLE bool hasException(const QDateTime &) const;
+
+    QVariantList recurExceptionDates() const;
+    Q_INVOKABLE void setExceptions(const QVariantList &);
+    Q_INVOKABLE void addExceptions(const QVariantList &);
 
     Reminder reminder() const;
     void setReminder(Reminder);
@@ -121,6 +128,9 @@ public:
 
     bool readonly() const;
 
+    Q_INVOKABLE void beginEdit();
+    Q_INVOKABLE void commitEdit(bool save = false);
+
     Q_INVOKABLE void save();
     Q_INVOKABLE void remove();
     Q_INVOKABLE QString vCalendar(const QString &prodId = QString()) const;
@@ -144,8 +154,33 @@ signals:
 private:
     friend class NemoCalendarEventCache;
 
+    enum Change {
+        DisplayLabelChange = 0x0001,
+        DescriptionChange = 0x0002,
+        StartTimeChange = 0x0004,
+        EndTimeChange = 0x0008,
+        AllDayChange = 0x0010,
+        RecurChange = 0x0020,
+        RecurExceptionsChange = 0x0040,
+        ReminderChange = 0x0080,
+        AlarmProgramChange = 0x0100
+    };
+
+    void notifyChanged(int changes);
+    void emitChanged(int changes);
+
+    void ensureLoaded() const;
+    int rebind(const KCalCore::Event::Ptr &);
+
+    KCalCore::DateTimeList exceptions() const;
+    static KCalCore::DateTimeList toExceptionList(const QVariantList &);
+    void setExceptionList(const KCalCore::DateTimeList &);
+
     bool mNewEvent:1;
     KCalCore::Event::Ptr mEvent;
+    KCalCore::Event::Ptr mEditEvent;
+    int mEditDepth;
+    int mPendingChanges;
 };
 
 class NemoCalendarEventOccurrence : public QObject
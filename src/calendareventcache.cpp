@@ -34,27 +34,126 @@
 #include <QDebug>
 #include <QSettings>
 #include <QCoreApplication>
+#include <QFileInfo>
 
 // mkcal
 #include <event.h>
 
+// kdepimlibs
+#include <ksystemtimezone.h>
+
 #include "calendardb.h"
 #include "calendarevent.h"
 #include "calendareventcache.h"
 #include "calendaragendamodel.h"
+#include "calendaroccurrencestore.h"
+#include "calendarlocalzone.h"
+#include "calendarstats.h"
+#include "calendarrecorder.h"
+
+// Delay before loading the storage after starting from the snapshot, giving
+// the agenda a chance to be shown first
+static const int WarmStartLoadDelay = 250;
+// Idle time after a load before the snapshot is rewritten
+static const int SnapshotWriteDelay = 5000;
+// Days either side of today covered by the snapshot
+static const int SnapshotDays = 14;
+// How often and how many times to look for the shared index republished
+// after the storage changed, before loading the storage instead
+static const int SharedRetryInterval = 200;
+static const int SharedRetryLimit = 25;
+// Number of occurrence lookups remembered by findOccurrence()
+static const int OccurrenceLookupLimit = 500;
+
+static const char LocalTimeFile[] = "/etc/localtime";
+
+// Posted to emit the change signals of wrappers rebound by ensureEventLoaded()
+static const QEvent::Type RebindEvent = QEvent::Type(QEvent::User + 1);
 
 NemoCalendarEventCache::NemoCalendarEventCache()
     : QObject(0)
     , mKCal::ExtendedStorageObserver()
+    , mRebinding(false)
+    , mDeferRebindSignals(false)
     , mRefreshEventSent(false)
+    , mWarm(false)
+    , mPublisher(false)
+    , mSharedAttempts(0)
 {
     NemoCalendarDb::storage()->registerObserver(this);
+    NemoCalendarDb::calendar()->registerObserver(&mSearchIndex);
+    NemoCalendarDb::calendar()->registerObserver(&mAlarmIndex);
+    NemoCalendarDb::calendar()->registerObserver(&mUpcomingIndex);
+
+    mSnapshotTimer.setSingleShot(true);
+    mSnapshotTimer.setInterval(SnapshotWriteDelay);
+    connect(&mSnapshotTimer, SIGNAL(timeout()), this, SLOT(writeSnapshot()));
+    mOccurrenceLookups.setMaxCost(OccurrenceLookupLimit);
+    mSharedTimer.setSingleShot(true);
+    mSharedTimer.setInterval(SharedRetryInterval);
+    connect(&mSharedTimer, SIGNAL(timeout()), this, SLOT(reopenShared()));
+    if (QCoreApplication::instance())
+        connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(aboutToQuit()));
+
+    // The zone file is usually a symlink that is replaced rather than
+    // written, so its directory is watched as well
+    mZoneFingerprint = zoneFingerprint();
+    mZoneWatcher.addPath(QLatin1String(LocalTimeFile));
+    mZoneWatcher.addPath(QFileInfo(QLatin1String(LocalTimeFile)).absolutePath());
+    connect(&mZoneWatcher, SIGNAL(fileChanged(QString)), this, SLOT(zoneFileChanged()));
+    connect(&mZoneWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(zoneFileChanged()));
+
+    NemoCalendarSnapshot::Stamp stamp;
+    if (NemoCalendarSnapshot::isEnabled())
+        stamp = NemoCalendarSnapshot::currentStamp();
+
+    if (NemoCalendarSnapshot::isSharingEnabled())
+        mPublisher = NemoCalendarSnapshot::claimPublisher(stamp);
+
+    if (stamp.isValid() && !mPublisher && NemoCalendarSnapshot::isSharingEnabled() && mSnapshot.openShared(stamp)) {
+        // Another process publishes the occurrences; use them until the
+        // storage is needed
+        startWarm(stamp);
+    } else if (stamp.isValid() && mSnapshot.open(stamp)) {
+        startWarm(stamp);
+        QTimer::singleShot(WarmStartLoadDelay, this, SLOT(finishWarmStart()));
+    } else {
+        load();
+    }
+}
 
-    load();
+// Serves agenda models from the open snapshot until the storage is loaded
+void NemoCalendarEventCache::startWarm(const NemoCalendarSnapshot::Stamp &stamp)
+{
+    QSettings settings("nemo", "nemo-qml-plugin-calendar");
+
+    mNotebooks.clear();
+    mNotebookColors = mSnapshot.notebookColors();
+    QStringList notebooks = mSnapshot.notebooks();
+    for (int ii = 0; ii < notebooks.count(); ++ii) {
+        QString uid = notebooks.at(ii);
+        if (!settings.value("exclude/" + uid, false).toBool())
+            mNotebooks.insert(uid);
+
+        QString color = settings.value("colors/" + uid, QString()).toString();
+        if (!color.isEmpty())
+            mNotebookColors.insert(uid, color);
+    }
+
+    mWarm = true;
+    if (!mSnapshot.isShared()) {
+        mSnapshotStamp = stamp;
+        mSnapshotDate = mSnapshot.startDate().addDays(SnapshotDays);
+    }
 }
 
 void NemoCalendarEventCache::load()
 {
+    NemoCalendarTrace trace(NemoCalendarStats::LoadStage);
+
+    if (NemoCalendarSnapshot::isEnabled())
+        mLoadStamp = NemoCalendarSnapshot::currentStamp();
+
     QSettings settings("nemo", "nemo-qml-plugin-calendar");
 
     mKCal::Notebook::List notebooks = NemoCalendarDb::storage()->notebooks();
@@ -82,18 +181,233 @@ void NemoCalendarEventCache::load()
 
     mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
 
+    // Placeholder events from the snapshot are rebound below
+    if (mWarm) {
+        mWarm = false;
+        mSnapshot.close();
+        mSharedTimer.stop();
+    }
+
+    // Take over publishing if the publishing process has gone
+    if (NemoCalendarSnapshot::isSharingEnabled() && !mPublisher)
+        mPublisher = NemoCalendarSnapshot::claimPublisher(mLoadStamp);
+
+    // The system time zone may have changed since the last load
+    QString localZone = KSystemTimeZones::local().name();
+    if (localZone != mLocalZone) {
+        mLocalZone = localZone;
+        localZoneChanged();
+    }
+
+    mSearchIndex.sync(calendar);
+    mAlarmIndex.sync(calendar);
+    mUpcomingIndex.sync(calendar);
+
+    // Lookups of events that are gone or have changed can never be used again
+    QList<QPair<QString, qint64> > lookups = mOccurrenceLookups.keys();
+    for (int ii = 0; ii < lookups.count(); ++ii) {
+        const OccurrenceLookup *lookup = mOccurrenceLookups.object(lookups.at(ii));
+        KCalCore::Event::Ptr event = lookup->event.toStrongRef();
+        if (!event || event->revision() != lookup->revision || event->lastModified() != lookup->lastModified)
+            mOccurrenceLookups.remove(lookups.at(ii));
+    }
+
+    mRebinding = true;
     for (QSet<NemoCalendarEvent *>::Iterator iter = mEvents.begin(); iter != mEvents.end(); ++iter) {
+        // Events not yet saved are not in the calendar
+        if ((*iter)->mNewEvent)
+            continue;
+
         QString uid = (*iter)->event()->uid();
         KCalCore::Event::Ptr event = calendar->event(uid);
-        (*iter)->setEvent(event);
+        if ((*iter)->event() != event)
+            NemoCalendarStats::count(NemoCalendarStats::WrappersRebound);
+
+        int changes = (*iter)->rebind(event);
+        if (mDeferRebindSignals)
+            mRebindChanges[*iter] |= changes;
+        else
+            (*iter)->emitChanged(changes);
     }
 
     for (QSet<NemoCalendarEventOccurrence *>::Iterator iter = mEventOccurrences.begin();
          iter != mEventOccurrences.end(); ++iter) {
         QString uid = (*iter)->event()->uid();
         KCalCore::Event::Ptr event = calendar->event(uid);
+        if ((*iter)->event() != event)
+            NemoCalendarStats::count(NemoCalendarStats::WrappersRebound);
         (*iter)->setEvent(event);
     }
+    mRebinding = false;
+
+    emit modelReset();
+
+    NemoCalendarStats::instance()->objectsChanged();
+
+    // Other processes wait for the shared index, so it is published as
+    // soon as possible
+    if (NemoCalendarSnapshot::isEnabled())
+        mSnapshotTimer.start(mPublisher ? 0 : SnapshotWriteDelay);
+}
+
+// Loads the storage now if the cache is still serving the snapshot
+void NemoCalendarEventCache::ensureLoaded()
+{
+    if (mWarm)
+        load();
+}
+
+// Drops the local times worked out so far, as they may be wrong since the
+// system time zone changed
+void NemoCalendarEventCache::localZoneChanged()
+{
+    NemoCalendarLocalZone::reset();
+    mOccurrenceLookups.clear();
+}
+
+void NemoCalendarEventCache::zoneFileChanged()
+{
+    // A replaced file drops out of the watcher
+    if (!mZoneWatcher.files().contains(QLatin1String(LocalTimeFile)))
+        mZoneWatcher.addPath(QLatin1String(LocalTimeFile));
+
+    QString fingerprint = zoneFingerprint();
+    if (fingerprint == mZoneFingerprint)
+        return;
+
+    mZoneFingerprint = fingerprint;
+    localZoneChanged();
+    emit timeZoneChanged();
+}
+
+// Identifies the configured zone by where the zone file leads and when it
+// was written
+QString NemoCalendarEventCache::zoneFingerprint()
+{
+    QFileInfo info(QLatin1String(LocalTimeFile));
+    return info.canonicalFilePath() + QLatin1Char(' ') + info.lastModified().toString(Qt::ISODate);
+}
+
+// Loads the storage from the event loop if the cache is still serving the
+// snapshot, for callers that need it but cannot load while being read
+void NemoCalendarEventCache::scheduleLoad()
+{
+    if (mWarm)
+        QTimer::singleShot(0, this, SLOT(finishWarmStart()));
+}
+
+// As ensureLoaded(), for a wrapper about to read or change its event.  The
+// wrapper may be read from inside a binding, so the change signals of the
+// rebound wrappers are emitted from the event loop rather than during the
+// read.  Nothing is loaded while wrappers are being rebound.
+void NemoCalendarEventCache::ensureEventLoaded()
+{
+    if (!mWarm || mRebinding)
+        return;
+
+    mDeferRebindSignals = true;
+    load();
+    mDeferRebindSignals = false;
+
+    if (!mRebindChanges.isEmpty())
+        QCoreApplication::postEvent(this, new QEvent(RebindEvent));
+}
+
+void NemoCalendarEventCache::finishWarmStart()
+{
+    ensureLoaded();
+}
+
+// Rewrites the snapshot, and republishes the shared index, if the storage
+// or the date changed since they were last written.  Nothing is written if
+// the database changed after the last load, as the load that follows will
+// schedule another attempt.
+void NemoCalendarEventCache::writeSnapshot()
+{
+    mSnapshotTimer.stop();
+
+    if (mWarm || !mLoadStamp.isValid())
+        return;
+
+    QDate today = QDate::currentDate();
+    bool writeFile = mLoadStamp != mSnapshotStamp || today != mSnapshotDate;
+    bool publish = mPublisher && (mLoadStamp != mPublishedStamp || today != mPublishedDate);
+    if ((!writeFile && !publish) || NemoCalendarSnapshot::currentStamp() != mLoadStamp)
+        return;
+
+    QDate start = today.addDays(-SnapshotDays);
+    QDate end = today.addDays(SnapshotDays);
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    mKCal::ExtendedCalendar::ExpandedIncidenceList occurrences =
+        calendar->rawExpandedEvents(start, end, false, false, KDateTime::Spec(KDateTime::LocalZone));
+
+    // Excluded notebooks are left out
+    mKCal::ExtendedCalendar::ExpandedIncidenceList visible;
+    for (int ii = 0; ii < occurrences.count(); ++ii) {
+        if (mNotebooks.contains(calendar->notebook(occurrences.at(ii).second)))
+            visible.append(occurrences.at(ii));
+    }
+
+    QByteArray data = NemoCalendarSnapshot::build(mLoadStamp, start, end, visible, calendar, mNotebookColors);
+
+    if (writeFile && NemoCalendarSnapshot::write(mLoadStamp, data)) {
+        mSnapshotStamp = mLoadStamp;
+        mSnapshotDate = today;
+    }
+
+    if (publish && NemoCalendarSnapshot::publish(mLoadStamp, data)) {
+        mPublishedStamp = mLoadStamp;
+        mPublishedDate = today;
+    }
+}
+
+// Writes the snapshot for the next start, and removes the shared index if
+// this process published it.  Readers keep the segment they have mapped;
+// the next process to load the storage publishes again.
+void NemoCalendarEventCache::aboutToQuit()
+{
+    bool publisher = mPublisher;
+    mPublisher = false;
+    writeSnapshot();
+
+    if (publisher)
+        NemoCalendarSnapshot::unpublish(mPublishedStamp);
+}
+
+// Maps the shared index republished after the storage changed, falling back
+// to loading the storage if it does not appear in time
+void NemoCalendarEventCache::reopenShared()
+{
+    if (!mWarm)
+        return;
+
+    NemoCalendarSnapshot::Stamp stamp = NemoCalendarSnapshot::currentStamp();
+    if (!mSnapshot.openShared(stamp)) {
+        if (++mSharedAttempts < SharedRetryLimit)
+            mSharedTimer.start();
+        else
+            load();
+        return;
+    }
+
+    startWarm(stamp);
+
+    // Rebind to the new placeholders; rows of events that are gone are
+    // removed by the agenda refresh
+    mRebinding = true;
+    for (QSet<NemoCalendarEvent *>::Iterator iter = mEvents.begin(); iter != mEvents.end(); ++iter) {
+        KCalCore::Event::Ptr event = (*iter)->event() ? mSnapshot.event((*iter)->event()->uid()) : KCalCore::Event::Ptr();
+        if (event)
+            (*iter)->setEvent(event);
+    }
+
+    for (QSet<NemoCalendarEventOccurrence *>::Iterator iter = mEventOccurrences.begin();
+         iter != mEventOccurrences.end(); ++iter) {
+        KCalCore::Event::Ptr event = (*iter)->event() ? mSnapshot.event((*iter)->event()->uid()) : KCalCore::Event::Ptr();
+        if (event)
+            (*iter)->setEvent(event);
+    }
+    mRebinding = false;
 
     emit modelReset();
 }
@@ -122,6 +436,15 @@ void NemoCalendarEventCache::storageModified(mKCal::ExtendedStorage *storage, co
     //
     // for now, let's just ask models to reload whenever a change happens.
 
+    NemoCalendarRecorder::record("storageModified", QStringList() << info);
+
+    // Wait for the publishing process to load the change and republish
+    if (mWarm && mSnapshot.isShared()) {
+        mSharedAttempts = 0;
+        mSharedTimer.start();
+        return;
+    }
+
     load();
 }
 
@@ -138,6 +461,13 @@ void NemoCalendarEventCache::storageFinished(mKCal::ExtendedStorage *storage, bo
     Q_UNUSED(info)
 }
 
+// The notebook of an incidence, including the placeholders served from the
+// snapshot before the storage is loaded
+QString NemoCalendarEventCache::notebook(const KCalCore::Incidence::Ptr &incidence) const
+{
+    return mWarm ? mSnapshot.notebook(incidence) : NemoCalendarDb::calendar()->notebook(incidence);
+}
+
 QString NemoCalendarEventCache::notebookColor(const QString &notebook) const
 {
     return mNotebookColors.value(notebook, "black");
@@ -171,10 +501,66 @@ QList<NemoCalendarEvent *> NemoCalendarEventCache::events(const KCalCore::Event:
     return rv;
 }
 
+// Returns the occurrence of event starting at startTime.  If there is no
+// occurrence with the exact start time, the first occurrence following
+// startTime is returned, or failing that the previous one.  The most
+// recently used results are remembered until the event is modified.
+mKCal::ExtendedCalendar::ExpandedIncidenceValidity NemoCalendarEventCache::findOccurrence(const KCalCore::Event::Ptr &event,
+                                                                                          const QDateTime &startTime)
+{
+    QPair<QString, qint64> key = qMakePair(event->uid(), startTime.isNull()?Q_INT64_C(-1):startTime.toMSecsSinceEpoch());
+    const OccurrenceLookup *cached = mOccurrenceLookups.object(key);
+    if (cached && cached->event.data() == event.data() &&
+        cached->revision == event->revision() && cached->lastModified == event->lastModified())
+        return cached->validity;
+
+    mKCal::ExtendedCalendar::ExpandedIncidenceValidity eiv = {
+        NemoCalendarLocalZone::toLocal(event->dtStart()),
+        NemoCalendarLocalZone::toLocal(event->dtEnd())
+    };
+
+    if (!startTime.isNull() && event->recurs()) {
+        KDateTime kStartTime = KDateTime(startTime, KDateTime::Spec(KDateTime::LocalZone));
+        KCalCore::Recurrence *recurrence = event->recurrence();
+        if (recurrence->recursAt(kStartTime)) {
+            eiv.dtStart = NemoCalendarLocalZone::toLocal(kStartTime);
+            eiv.dtEnd = NemoCalendarLocalZone::toLocal(KCalCore::Duration(event->dtStart(), event->dtEnd()).end(kStartTime));
+        } else {
+            KDateTime match = recurrence->getNextDateTime(kStartTime);
+            if (match.isNull())
+                match = recurrence->getPreviousDateTime(kStartTime);
+
+            if (!match.isNull()) {
+                eiv.dtStart = NemoCalendarLocalZone::toLocal(match);
+                eiv.dtEnd = NemoCalendarLocalZone::toLocal(KCalCore::Duration(event->dtStart(), event->dtEnd()).end(match));
+            }
+        }
+    }
+
+    OccurrenceLookup *lookup = new OccurrenceLookup;
+    lookup->event = event.toWeakRef();
+    lookup->revision = event->revision();
+    lookup->lastModified = event->lastModified();
+    lookup->validity = eiv;
+    mOccurrenceLookups.insert(key, lookup);
+
+    return eiv;
+}
+
 bool NemoCalendarEventCache::event(QEvent *e)
 {
-    if (e->type() == QEvent::User)
+    if (e->type() == QEvent::User) {
         doAgendaRefresh();
+    } else if (e->type() == RebindEvent) {
+        // Wrappers deleted by a handler remove themselves from the pending set
+        while (!mRebindChanges.isEmpty()) {
+            QHash<NemoCalendarEvent *, int>::Iterator iter = mRebindChanges.begin();
+            NemoCalendarEvent *event = iter.key();
+            int changes = iter.value();
+            mRebindChanges.erase(iter);
+            event->emitChanged(changes);
+        }
+    }
     return QObject::event(e);
 }
 
@@ -212,9 +598,21 @@ struct AgendaDateRange
 
 void NemoCalendarEventCache::doAgendaRefresh()
 {
+    NemoCalendarRecorder::record("refresh");
+
     if (mRefreshModels.isEmpty())
         return;
 
+    // Ranges outside the snapshot need the storage
+    if (mWarm) {
+        bool covered = true;
+        for (QSet<NemoCalendarAgendaModel *>::ConstIterator iter = mRefreshModels.begin();
+             covered && iter != mRefreshModels.end(); ++iter)
+            covered = mSnapshot.covers((*iter)->startDate(), agenda_endDate(*iter));
+        if (!covered)
+            load();
+    }
+
     QList<NemoCalendarAgendaModel *> models = mRefreshModels.toList();
     mRefreshModels.clear();
     mRefreshEventSent = false;
@@ -245,23 +643,25 @@ void NemoCalendarEventCache::doAgendaRefresh()
     for (int ii = 0; ii < ranges.count(); ++ii) {
         const AgendaDateRange &r = ranges.at(ii);
 
-        mKCal::ExtendedCalendar::ExpandedIncidenceList newEvents =
-            calendar->rawExpandedEvents(r.start, r.end, false, false, KDateTime::Spec(KDateTime::LocalZone));
+        // Filtered by notebook and sorted once for all the models in the range
+        NemoCalendarOccurrenceStore store;
+        {
+            NemoCalendarTrace trace(NemoCalendarStats::ExpandStage);
+            mKCal::ExtendedCalendar::ExpandedIncidenceList newEvents;
+            if (mWarm)
+                newEvents = mSnapshot.occurrences(r.start, r.end);
+            else
+                newEvents = calendar->rawExpandedEvents(r.start, r.end, false, false, KDateTime::Spec(KDateTime::LocalZone));
+            NemoCalendarStats::count(NemoCalendarStats::OccurrencesExpanded, newEvents.count());
+            store.assign(newEvents, mNotebooks);
+        }
 
         for (int jj = 0; jj < r.models.count(); ++jj) {
             NemoCalendarAgendaModel *m = r.models.at(jj);
-            QDate start = m->startDate();
-            QDate end = agenda_endDate(m);
-            mKCal::ExtendedCalendar::ExpandedIncidenceList filtered;
-            for (int kk = 0; kk < newEvents.count(); ++kk) {
-                mKCal::ExtendedCalendar::ExpandedIncidenceValidity validity = newEvents.at(kk).first;
-                if ((validity.dtStart.date() < start && validity.dtEnd.date() >= start)
-                        || (validity.dtStart.date() >= start && validity.dtStart.date() <= end))
-                    filtered.append(newEvents.at(kk));
-            }
-
-            m->doRefresh(filtered);
+            m->doRefresh(store, store.overlapping(m->startDate(), agenda_endDate(m)));
         }
     }
+
+    NemoCalendarStats::instance()->objectsChanged();
 }
 
@@ -35,11 +35,22 @@
 
 // Qt
 #include <QSet>
+#include <QCache>
+#include <QTimer>
 #include <QObject>
+#include <QDateTime>
+#include <QWeakPointer>
+#include <QFileSystemWatcher>
 
 // mkcal
 #include <event.h>
 #include <extendedstorage.h>
+#include <extendedcalendar.h>
+
+#include "calendarsearchindex.h"
+#include "calendaralarmindex.h"
+#include "calendarupcomingindex.h"
+#include "calendarsnapshot.h"
 
 class NemoCalendarEvent;
 class NemoCalendarAgendaModel;
@@ -53,33 +64,62 @@ private:
 public:
     static NemoCalendarEventCache *instance();
     void load();
+    void ensureLoaded();
+    void scheduleLoad();
 
     /* mKCal::ExtendedStorageObserver */
     void storageModified(mKCal::ExtendedStorage *storage, const QString &info);
     void storageProgress(mKCal::ExtendedStorage *storage, const QString &info);
     void storageFinished(mKCal::ExtendedStorage *storage, bool error, const QString &info);
 
+    QString notebook(const KCalCore::Incidence::Ptr &incidence) const;
     QString notebookColor(const QString &) const;
     void setNotebookColor(const QString &, const QString &);
 
     static QList<NemoCalendarEvent *> events(const KCalCore::Event::Ptr &event);
 
+    mKCal::ExtendedCalendar::ExpandedIncidenceValidity findOccurrence(const KCalCore::Event::Ptr &event,
+                                                                      const QDateTime &startTime);
+
 protected:
     virtual bool event(QEvent *);
 
 signals:
     void modelReset();
+    void timeZoneChanged();
+
+private slots:
+    void finishWarmStart();
+    void writeSnapshot();
+    void aboutToQuit();
+    void reopenShared();
+    void zoneFileChanged();
 
 private:
     friend class NemoCalendarApi;
     friend class NemoCalendarEvent;
     friend class NemoCalendarAgendaModel;
     friend class NemoCalendarEventOccurrence;
+    friend class NemoCalendarSearchModel;
+    friend class NemoCalendarUpcomingModel;
+    friend class NemoCalendarStats;
 
     void scheduleAgendaRefresh(NemoCalendarAgendaModel *);
     void cancelAgendaRefresh(NemoCalendarAgendaModel *);
     void doAgendaRefresh();
 
+    void startWarm(const NemoCalendarSnapshot::Stamp &stamp);
+    void localZoneChanged();
+    static QString zoneFingerprint();
+    void ensureEventLoaded();
+
+    struct OccurrenceLookup {
+        QWeakPointer<KCalCore::Event> event;
+        int revision;
+        KDateTime lastModified;
+        mKCal::ExtendedCalendar::ExpandedIncidenceValidity validity;
+    };
+
     QStringList mDefaultNotebookColors;
 
     QSet<QString> mNotebooks;
@@ -87,8 +127,42 @@ private:
     QSet<NemoCalendarEvent *> mEvents;
     QSet<NemoCalendarEventOccurrence *> mEventOccurrences;
 
+    // Set while wrappers are rebound, and while their change signals are
+    // held back to be emitted from the event loop
+    bool mRebinding;
+    bool mDeferRebindSignals;
+    QHash<NemoCalendarEvent *, int> mRebindChanges;
+
+    NemoCalendarSearchIndex mSearchIndex;
+    NemoCalendarAlarmIndex mAlarmIndex;
+    NemoCalendarUpcomingIndex mUpcomingIndex;
+
+    // (uid, requested start time in msecs since epoch) -> resolved occurrence,
+    // least recently used entries first to go
+    QCache<QPair<QString, qint64>, OccurrenceLookup> mOccurrenceLookups;
+    // Name of the system time zone at the last load
+    QString mLocalZone;
+    // Watches the zone file for every NemoCalendarClockTimer
+    QFileSystemWatcher mZoneWatcher;
+    QString mZoneFingerprint;
+
     bool mRefreshEventSent;
     QSet<NemoCalendarAgendaModel *> mRefreshModels;
+
+    // Set while agenda models are served from the snapshot
+    bool mWarm;
+    NemoCalendarSnapshot mSnapshot;
+    NemoCalendarSnapshot::Stamp mLoadStamp;
+    NemoCalendarSnapshot::Stamp mSnapshotStamp;
+    QDate mSnapshotDate;
+    QTimer mSnapshotTimer;
+
+    // Whether this process publishes the shared occurrence index
+    bool mPublisher;
+    NemoCalendarSnapshot::Stamp mPublishedStamp;
+    QDate mPublishedDate;
+    QTimer mSharedTimer;
+    int mSharedAttempts;
 };
 
 #endif // CALENDAREVENTCACHE_H
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendareventlistquery.h"
+
+#include "calendardb.h"
+#include "calendarevent.h"
+#include "calendareventcache.h"
+
+NemoCalendarEventListQuery::NemoCalendarEventListQuery(QObject *parent)
+: QAbstractListModel(parent), mIsComplete(true)
+{
+    mRoleNames[UniqueIdRole] = "uniqueId";
+    mRoleNames[StartTimeRole] = "startTime";
+    mRoleNames[EventObjectRole] = "event";
+    mRoleNames[OccurrenceObjectRole] = "occurrence";
+
+    connect(NemoCalendarEventCache::instance(), SIGNAL(modelReset()), this, SLOT(refresh()));
+}
+
+NemoCalendarEventListQuery::~NemoCalendarEventListQuery()
+{
+    for (int ii = 0; ii < mEntries.count(); ++ii)
+        delete mEntries.at(ii).occurrence;
+}
+
+QHash<int, QByteArray> NemoCalendarEventListQuery::roleNames() const
+{
+    return mRoleNames;
+}
+
+// The list of occurrences to resolve.  Each entry is either a uid string or
+// an object with uniqueId and startTime properties, which behave like the
+// properties of the same name on EventQuery.
+QVariantList NemoCalendarEventListQuery::queries() const
+{
+    return mQueries;
+}
+
+// Looks up each distinct uid only once per pass
+static KCalCore::Event::Ptr lookupEvent(QHash<QString, KCalCore::Event::Ptr> &resolved, const QString &uid)
+{
+    QHash<QString, KCalCore::Event::Ptr>::ConstIterator iter = resolved.find(uid);
+    if (iter != resolved.end())
+        return iter.value();
+
+    KCalCore::Event::Ptr event = uid.isEmpty()?KCalCore::Event::Ptr():NemoCalendarDb::calendar()->event(uid);
+    resolved.insert(uid, event);
+    return event;
+}
+
+void NemoCalendarEventListQuery::setQueries(const QVariantList &queries)
+{
+    if (mQueries == queries)
+        return;
+
+    mQueries = queries;
+
+    if (mIsComplete)
+        NemoCalendarEventCache::instance()->ensureLoaded();
+
+    int oldEntryCount = mEntries.count();
+
+    beginResetModel();
+    for (int ii = 0; ii < mEntries.count(); ++ii)
+        delete mEntries.at(ii).occurrence;
+    mEntries.clear();
+
+    QHash<QString, KCalCore::Event::Ptr> resolved;
+    for (int ii = 0; ii < mQueries.count(); ++ii) {
+        const QVariant &query = mQueries.at(ii);
+
+        Entry entry;
+        entry.revision = 0;
+        entry.occurrence = 0;
+        if (query.type() == QVariant::Map) {
+            QVariantMap map = query.toMap();
+            entry.uid = map.value("uniqueId").toString();
+            entry.startTime = map.value("startTime").toDateTime();
+        } else {
+            entry.uid = query.toString();
+        }
+
+        if (mIsComplete)
+            resolve(entry, lookupEvent(resolved, entry.uid));
+
+        mEntries.append(entry);
+    }
+    endResetModel();
+
+    emit queriesChanged();
+    if (oldEntryCount != mEntries.count())
+        emit countChanged();
+}
+
+int NemoCalendarEventListQuery::count() const
+{
+    return mEntries.count();
+}
+
+int NemoCalendarEventListQuery::rowCount(const QModelIndex &index) const
+{
+    if (index != QModelIndex())
+        return 0;
+
+    return mEntries.count();
+}
+
+QVariant NemoCalendarEventListQuery::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mEntries.count())
+        return QVariant();
+
+    const Entry &entry = mEntries.at(index.row());
+
+    switch (role) {
+        case UniqueIdRole:
+            return entry.uid;
+        case StartTimeRole:
+            return entry.startTime;
+        case EventObjectRole:
+            return QVariant::fromValue<QObject *>(entry.occurrence?entry.occurrence->eventObject():0);
+        case OccurrenceObjectRole:
+            return QVariant::fromValue<QObject *>(entry.occurrence);
+        default:
+            return QVariant();
+    }
+}
+
+void NemoCalendarEventListQuery::classBegin()
+{
+    mIsComplete = false;
+}
+
+void NemoCalendarEventListQuery::componentComplete()
+{
+    mIsComplete = true;
+    refresh();
+}
+
+// Re-resolves only the entries whose event has been added, removed or
+// modified since they were last resolved.
+void NemoCalendarEventListQuery::refresh()
+{
+    if (!mIsComplete)
+        return;
+
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
+    QHash<QString, KCalCore::Event::Ptr> resolved;
+    for (int ii = 0; ii < mEntries.count(); ++ii) {
+        Entry &entry = mEntries[ii];
+        KCalCore::Event::Ptr event = lookupEvent(resolved, entry.uid);
+
+        if (event == entry.event &&
+            (!event || (event->revision() == entry.revision && event->lastModified() == entry.lastModified)))
+            continue;
+
+        if (resolve(entry, event))
+            emit dataChanged(index(ii), index(ii));
+    }
+}
+
+// Updates entry to match event, returning true if its occurrence object was
+// replaced or removed.
+bool NemoCalendarEventListQuery::resolve(Entry &entry, const KCalCore::Event::Ptr &event)
+{
+    entry.event = event;
+    entry.revision = event?event->revision():0;
+    entry.lastModified = event?event->lastModified():KDateTime();
+
+    if (!event) {
+        if (!entry.occurrence)
+            return false;
+
+        delete entry.occurrence;
+        entry.occurrence = 0;
+        return true;
+    }
+
+    mKCal::ExtendedCalendar::ExpandedIncidenceValidity eiv =
+        NemoCalendarEventCache::instance()->findOccurrence(event, entry.startTime);
+
+    if (entry.occurrence && entry.occurrence->startTime() == eiv.dtStart &&
+        entry.occurrence->endTime() == eiv.dtEnd) {
+        if (entry.occurrence->event() != event)
+            entry.occurrence->setEvent(event);
+        return false;
+    }
+
+    delete entry.occurrence;
+    entry.occurrence = new NemoCalendarEventOccurrence(qMakePair(eiv, event.dynamicCast<KCalCore::Incidence>()),
+                                                       this);
+    return true;
+}
@@ -107,37 +107,28 @@ void NemoCalendarEventQuery::refresh()
     if (!mIsComplete)
         return;
 
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
     mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
     KCalCore::Event::Ptr event = mUid.isEmpty()?KCalCore::Event::Ptr():calendar->event(mUid);
     if (event) {
+        mKCal::ExtendedCalendar::ExpandedIncidenceValidity eiv =
+            NemoCalendarEventCache::instance()->findOccurrence(event, mStartTime);
+
+        // Keep the existing occurrence if it still resolves to the same
+        // instance, so that bindings on it are not needlessly re-evaluated
+        if (mOccurrence && mOccurrence->event() && mOccurrence->event()->uid() == event->uid() &&
+            mOccurrence->startTime() == eiv.dtStart && mOccurrence->endTime() == eiv.dtEnd) {
+            if (mOccurrence->event() != event)
+                mOccurrence->setEvent(event);
+            return;
+        }
+
         if (mOccurrence) {
             delete mOccurrence;
             mOccurrence = 0;
         }
 
-        mKCal::ExtendedCalendar::ExpandedIncidenceValidity eiv = {
-            event->dtStart().toLocalZone().dateTime(),
-            event->dtEnd().toLocalZone().dateTime()
-        };
-
-        if (!mStartTime.isNull() && event->recurs()) {
-            KDateTime startTime = KDateTime(mStartTime, KDateTime::Spec(KDateTime::LocalZone));
-            KCalCore::Recurrence *recurrence = event->recurrence();
-            if (recurrence->recursAt(startTime)) {
-                eiv.dtStart = startTime.toLocalZone().dateTime();
-                eiv.dtEnd = KCalCore::Duration(event->dtStart(), event->dtEnd()).end(startTime).toLocalZone().dateTime();
-            } else {
-                KDateTime match = recurrence->getNextDateTime(startTime);
-                if (match.isNull())
-                    match = recurrence->getPreviousDateTime(startTime);
-
-                if (!match.isNull()) {
-                    eiv.dtStart = match.toLocalZone().dateTime();
-                    eiv.dtEnd = KCalCore::Duration(event->dtStart(), event->dtEnd()).end(match).toLocalZone().dateTime();
-                }
-            }
-        }
-
         mOccurrence = new NemoCalendarEventOccurrence(qMakePair(eiv, event.dynamicCast<KCalCore::Incidence>()), 
                                                       this);
         emit occurrenceChanged();
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarexporter.h"
+
+#include <QIODevice>
+
+// mkcal
+#include <icalformat.h>
+#include <icaltimezones.h>
+#include <vcalformat.h>
+#include <libical/vobject.h>
+
+// kdepimlibs
+#include <ksystemtimezone.h>
+
+#include "calendardb.h"
+#include "calendareventcache.h"
+#include "calendarvcalwriter.h"
+
+// Output is handed to the device in chunks of about this many bytes
+static const int ChunkSize = 64 * 1024;
+
+// eventToVEvent() is protected
+class NemoCalendarExportVCalFormat : public KCalCore::VCalFormat
+{
+public:
+    QByteArray vEvent(const KCalCore::Event::Ptr &event)
+    {
+        VObject *vEventObj = eventToVEvent(event);
+        char *memVObject = writeMemVObject(0, 0, vEventObj);
+        QByteArray retn(memVObject);
+        free(memVObject);
+        cleanVObject(vEventObj);
+        return retn;
+    }
+};
+
+// Events to export are collected on the calling thread and copied, so the
+// calendar is not touched while the thread writes them out.
+NemoCalendarExporter::NemoCalendarExporter(QIODevice *device, Format format, QObject *parent)
+: QThread(parent), mDevice(device), mFormat(format), mCancelled(0), mSuccess(true)
+{
+}
+
+// Stops an export still in progress, leaving the output incomplete
+NemoCalendarExporter::~NemoCalendarExporter()
+{
+    mCancelled.storeRelease(1);
+    wait();
+}
+
+// Adds all events of a notebook
+void NemoCalendarExporter::addNotebook(const QString &notebookUid)
+{
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    KCalCore::Event::List events = calendar->rawEvents();
+    QHash<QString, QDate> zones;
+
+    for (int ii = 0; ii < events.count(); ++ii) {
+        if (calendar->notebook(events.at(ii)) == notebookUid)
+            addEvent(events.at(ii), zones);
+    }
+
+    addTimeZones(zones);
+}
+
+// Adds all events with an occurrence between start and end inclusive
+void NemoCalendarExporter::addRange(const QDate &start, const QDate &end)
+{
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
+    mKCal::ExtendedCalendar::ExpandedIncidenceList occurrences =
+        NemoCalendarDb::calendar()->rawExpandedEvents(start, end, false, false, KDateTime::Spec(KDateTime::LocalZone));
+
+    QHash<QString, QDate> zones;
+
+    for (int ii = 0; ii < occurrences.count(); ++ii) {
+        KCalCore::Event::Ptr event = occurrences.at(ii).second.dynamicCast<KCalCore::Event>();
+        if (event)
+            addEvent(event, zones);
+    }
+
+    addTimeZones(zones);
+}
+
+// Copies event unless it was already added, noting the time zones it uses
+// in zones with the earliest date they are needed from
+void NemoCalendarExporter::addEvent(const KCalCore::Event::Ptr &event, QHash<QString, QDate> &zones)
+{
+    QString instance = event->uid() + event->recurrenceId().toString();
+    if (mInstances.contains(instance))
+        return;
+
+    mInstances.insert(instance);
+    mEvents.append(KCalCore::Event::Ptr(event->clone()));
+
+    if (mFormat != ICalendar)
+        return;
+
+    KDateTime times[] = { event->dtStart(), event->dtEnd(), event->recurrenceId() };
+    for (unsigned ii = 0; ii < sizeof(times) / sizeof(times[0]); ++ii) {
+        const KDateTime &time = times[ii];
+        if (!time.isValid() || time.isUtc() || time.isClockTime() || time.isOffsetFromUtc())
+            continue;
+
+        QString name = time.timeZone().name();
+        QHash<QString, QDate>::Iterator zone = zones.find(name);
+        if (zone == zones.end())
+            zones.insert(name, time.date());
+        else if (time.date() < *zone)
+            *zone = time.date();
+    }
+}
+
+// Builds the VTIMEZONE components of zones.  This reads the system time
+// zone data, so it is done here rather than on the export thread.
+void NemoCalendarExporter::addTimeZones(const QHash<QString, QDate> &zones)
+{
+    for (QHash<QString, QDate>::ConstIterator iter = zones.begin(); iter != zones.end(); ++iter) {
+        QHash<QString, QDate>::ConstIterator start = mTimeZoneStarts.find(iter.key());
+        if (start != mTimeZoneStarts.end() && *start <= iter.value())
+            continue;
+
+        KTimeZone zone = KSystemTimeZones::zone(iter.key());
+        if (!zone.isValid())
+            continue;
+
+        // A day earlier covers times that are on the previous day in UTC
+        QDate earliest = iter.value().addDays(-1);
+        mTimeZones.insert(iter.key(), KCalCore::ICalTimeZone(zone, earliest).vtimezone());
+        mTimeZoneStarts.insert(iter.key(), iter.value());
+    }
+}
+
+int NemoCalendarExporter::count() const
+{
+    return mEvents.count();
+}
+
+bool NemoCalendarExporter::success() const
+{
+    return mSuccess;
+}
+
+// Appends the VEVENT of event as serialized by libical, without converting
+// it to a QString.  Any time zones appended after the component are
+// dropped, as run() writes each zone once before the events.
+static void writeVEvent(QByteArray &buffer, KCalCore::ICalFormat &format, const KCalCore::Event::Ptr &event)
+{
+    static const char end[] = "END:VEVENT\r\n";
+
+    QByteArray text = format.toRawString(event);
+    int index = text.lastIndexOf(end);
+    if (index >= 0)
+        text.truncate(index + int(sizeof(end)) - 1);
+    buffer += text;
+}
+
+void NemoCalendarExporter::run()
+{
+    QByteArray buffer;
+    buffer.reserve(ChunkSize + ChunkSize / 4);
+
+    buffer += "BEGIN:VCALENDAR\r\n"
+              "PRODID:-//NemoMobile.org/Nemo//NONSGML v1.0//EN\r\n";
+    buffer += mFormat == ICalendar?"VERSION:2.0\r\n":"VERSION:1.0\r\n";
+
+    // Every zone referred to by a TZID needs its VTIMEZONE in the calendar
+    for (QHash<QString, QByteArray>::ConstIterator iter = mTimeZones.begin(); iter != mTimeZones.end(); ++iter)
+        buffer += *iter;
+
+    KCalCore::ICalFormat icalFormat;
+    NemoCalendarExportVCalFormat vcalFormat;
+
+    for (int ii = 0; ii < mEvents.count() && mSuccess; ++ii) {
+        if (mCancelled.loadAcquire()) {
+            mSuccess = false;
+            return;
+        }
+
+        const KCalCore::Event::Ptr &event = mEvents.at(ii);
+        if (mFormat == ICalendar)
+            writeVEvent(buffer, icalFormat, event);
+        else if (NemoCalendarVCalWriter::canWrite(event))
+            NemoCalendarVCalWriter::writeVEvent(buffer, event);
+        else
+            buffer += vcalFormat.vEvent(event);
+
+        if (buffer.size() >= ChunkSize)
+            mSuccess = flush(buffer);
+    }
+
+    buffer += "END:VCALENDAR\r\n";
+    if (mSuccess)
+        mSuccess = flush(buffer);
+}
+
+bool NemoCalendarExporter::flush(QByteArray &buffer)
+{
+    bool rv = mDevice->write(buffer) == buffer.size();
+    buffer.resize(0);
+    return rv;
+}
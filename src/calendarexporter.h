@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDAREXPORTER_H
+#define CALENDAREXPORTER_H
+
+#include <QSet>
+#include <QHash>
+#include <QDate>
+#include <QThread>
+#include <QAtomicInt>
+
+// mkcal
+#include <event.h>
+
+class QIODevice;
+
+class NemoCalendarExporter : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        ICalendar,
+        VCalendar
+    };
+
+    NemoCalendarExporter(QIODevice *device, Format format, QObject *parent = 0);
+    ~NemoCalendarExporter();
+
+    void addNotebook(const QString &notebookUid);
+    void addRange(const QDate &start, const QDate &end);
+
+    int count() const;
+    bool success() const;
+
+protected:
+    virtual void run();
+
+private:
+    void addEvent(const KCalCore::Event::Ptr &event, QHash<QString, QDate> &zones);
+    void addTimeZones(const QHash<QString, QDate> &zones);
+    bool flush(QByteArray &buffer);
+
+    QIODevice *mDevice;
+    Format mFormat;
+    KCalCore::Event::List mEvents;
+    QSet<QString> mInstances;
+    // VTIMEZONE components of the zones used, and the earliest date each
+    // one covers
+    QHash<QString, QByteArray> mTimeZones;
+    QHash<QString, QDate> mTimeZoneStarts;
+    QAtomicInt mCancelled;
+    bool mSuccess;
+};
+
+#endif // CALENDAREXPORTER_H
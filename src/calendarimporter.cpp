@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarimporter.h"
+
+#include <QCoreApplication>
+
+// mkcal
+#include <icalformat.h>
+#include <memorycalendar.h>
+
+#include "calendardb.h"
+#include "calendareventcache.h"
+
+// Number of events parsed and saved together.  This bounds the memory used
+// for reading and parsing however large the input is; the imported events
+// themselves stay loaded in the calendar, as for any other notebook shown.
+static const int BatchSize = 100;
+
+NemoCalendarImporter::NemoCalendarImporter(const QString &fileName, const QString &notebookUid, QObject *parent)
+: QObject(parent), mFile(fileName), mNotebook(notebookUid), mTarget(0), mDepth(0), mBatchCount(0),
+  mImported(0), mSkipped(0), mSuccess(true)
+{
+    if (mNotebook.isEmpty())
+        mNotebook = NemoCalendarDb::storage()->defaultNotebook()->uid();
+}
+
+// Fails if the notebook does not exist or cannot be written, or if the file
+// cannot be opened
+bool NemoCalendarImporter::start()
+{
+    mKCal::Notebook::Ptr notebook = NemoCalendarDb::storage()->notebook(mNotebook);
+    if (!notebook || notebook->isReadOnly()) {
+        qWarning("Calendar import: cannot import into notebook %s", qPrintable(mNotebook));
+        return false;
+    }
+
+    if (!mFile.open(QIODevice::ReadOnly))
+        return false;
+
+    QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+    return true;
+}
+
+bool NemoCalendarImporter::event(QEvent *e)
+{
+    if (e->type() == QEvent::User) {
+        bool more = readBatch();
+        importBatch();
+
+        emit progress(mFile.pos(), mFile.size());
+
+        if (more) {
+            QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+        } else {
+            mFile.close();
+            emit finished(mImported, mSkipped, mSuccess);
+        }
+    }
+    return QObject::event(e);
+}
+
+// Reads complete VEVENT components into mBatch until it holds BatchSize of
+// them.  Returns false once the input is exhausted.  Time zone definitions
+// are kept for the whole import, since any later event may refer to them;
+// other components are skipped.
+bool NemoCalendarImporter::readBatch()
+{
+    while (mBatchCount < BatchSize) {
+        if (mFile.atEnd()) {
+            // An event cut off by the end of the input is reported rather
+            // than dropped silently
+            if (mTarget == &mComponent) {
+                qWarning("Calendar import: incomplete event at the end of %s", qPrintable(mFile.fileName()));
+                ++mSkipped;
+                mSuccess = false;
+            }
+            mComponent.clear();
+            mTarget = 0;
+            mDepth = 0;
+            return false;
+        }
+
+        QByteArray line = mFile.readLine();
+
+        // Folded continuation of the previous line
+        if (line.startsWith(' ') || line.startsWith('\t')) {
+            if (mTarget)
+                mTarget->append(line);
+            continue;
+        }
+
+        QByteArray name = line.trimmed().toUpper();
+        if (name.startsWith("BEGIN:")) {
+            if (mDepth == 0) {
+                if (name == "BEGIN:VCALENDAR")
+                    continue;
+
+                if (name == "BEGIN:VEVENT")
+                    mTarget = &mComponent;
+                else if (name == "BEGIN:VTIMEZONE")
+                    mTarget = &mTimeZones;
+                else
+                    mTarget = 0;
+            }
+            ++mDepth;
+        } else if (name.startsWith("END:")) {
+            if (mDepth == 0)
+                continue;
+
+            if (--mDepth == 0) {
+                if (mTarget)
+                    mTarget->append(line);
+
+                if (mTarget == &mComponent) {
+                    mBatch.append(mComponent);
+                    mComponent.clear();
+                    ++mBatchCount;
+                }
+
+                mTarget = 0;
+                continue;
+            }
+        }
+
+        if (mTarget)
+            mTarget->append(line);
+    }
+
+    return true;
+}
+
+// Parses the current batch and adds events whose uid is not already in the
+// calendar to the target notebook, saving them in one transaction.
+void NemoCalendarImporter::importBatch()
+{
+    if (mBatchCount == 0)
+        return;
+
+    QByteArray text = "BEGIN:VCALENDAR\r\n"
+                      "VERSION:2.0\r\n"
+                      "PRODID:-//NemoMobile.org/Nemo//NONSGML v1.0//EN\r\n";
+    text += mTimeZones;
+    text += mBatch;
+    text += "END:VCALENDAR\r\n";
+
+    mBatch.clear();
+
+    KCalCore::MemoryCalendar::Ptr batch(new KCalCore::MemoryCalendar(KDateTime::Spec::LocalZone()));
+    KCalCore::ICalFormat format;
+    if (!format.fromString(batch, QString::fromUtf8(text))) {
+        qWarning("Calendar import: failed to parse %d events from %s", mBatchCount, qPrintable(mFile.fileName()));
+        mSkipped += mBatchCount;
+        mSuccess = false;
+        mBatchCount = 0;
+        return;
+    }
+
+    mBatchCount = 0;
+
+    NemoCalendarEventCache::instance()->ensureLoaded();
+
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    KCalCore::Event::List events = batch->rawEvents();
+    int added = 0;
+    for (int ii = 0; ii < events.count(); ++ii) {
+        const KCalCore::Event::Ptr &event = events.at(ii);
+        if (calendar->event(event->uid(), event->recurrenceId())) {
+            ++mSkipped;
+            continue;
+        }
+
+        if (calendar->addEvent(KCalCore::Event::Ptr(event->clone()), mNotebook)) {
+            ++added;
+        } else {
+            qWarning("Calendar import: cannot add event %s", qPrintable(event->uid()));
+            ++mSkipped;
+            mSuccess = false;
+        }
+    }
+
+    // Events only count as imported once they are in the storage
+    if (NemoCalendarDb::save()) {
+        mImported += added;
+    } else {
+        qWarning("Calendar import: cannot save %d events from %s", added, qPrintable(mFile.fileName()));
+        mSkipped += added;
+        mSuccess = false;
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARIMPORTER_H
+#define CALENDARIMPORTER_H
+
+#include <QFile>
+#include <QObject>
+
+class NemoCalendarImporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    NemoCalendarImporter(const QString &fileName, const QString &notebookUid, QObject *parent = 0);
+
+    bool start();
+
+signals:
+    void progress(qint64 bytesRead, qint64 bytesTotal);
+    void finished(int imported, int skipped, bool success);
+
+protected:
+    virtual bool event(QEvent *);
+
+private:
+    bool readBatch();
+    void importBatch();
+
+    QFile mFile;
+    QString mNotebook;
+
+    // Text of the VTIMEZONE components read so far, and of the VEVENT
+    // components of the current batch
+    QByteArray mTimeZones;
+    QByteArray mBatch;
+    QByteArray mComponent;
+    QByteArray *mTarget;
+    int mDepth;
+    int mBatchCount;
+
+    int mImported;
+    int mSkipped;
+    bool mSuccess;
+};
+
+#endif // CALENDARIMPORTER_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarlocalzone.h"
+
+#include <QVector>
+#include <QtAlgorithms>
+
+#include <ksystemtimezone.h>
+
+namespace {
+
+struct TransitionTable
+{
+    TransitionTable() : valid(false), start(0), end(0), initialOffset(0) {}
+
+    bool valid;
+    QString zone;
+    qint64 start;               // window covered, in seconds since the epoch (UTC)
+    qint64 end;
+    int initialOffset;          // offset in effect at start
+    QVector<qint64> times;      // transition times, seconds since the epoch (UTC)
+    QVector<int> offsets;       // offset in effect from the matching transition
+};
+
+TransitionTable table;
+
+QDateTime fromSecs(qint64 secs)
+{
+    return QDateTime::fromMSecsSinceEpoch(secs * 1000).toUTC();
+}
+
+qint64 yearStart(int year)
+{
+    return QDateTime(QDate(year, 1, 1), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch() / 1000;
+}
+
+// Rebuilds the table so that it covers secs, extending the current window
+// to a few years either side
+bool ensureCovered(qint64 secs)
+{
+    if (table.valid && secs >= table.start && secs < table.end)
+        return true;
+
+    KTimeZone zone = KSystemTimeZones::local();
+    if (!zone.isValid())
+        return false;
+
+    int year = fromSecs(secs).date().year();
+    qint64 start = yearStart(year - 2);
+    qint64 end = yearStart(year + 3);
+    if (table.valid && table.zone == zone.name()) {
+        start = qMin(start, table.start);
+        end = qMax(end, table.end);
+    }
+
+    QList<KTimeZone::Transition> transitions = zone.transitions(fromSecs(start), fromSecs(end));
+
+    table.valid = true;
+    table.zone = zone.name();
+    table.start = start;
+    table.end = end;
+    table.initialOffset = zone.offsetAtUtc(fromSecs(start));
+    table.times.clear();
+    table.offsets.clear();
+    table.times.reserve(transitions.count());
+    table.offsets.reserve(transitions.count());
+    for (int ii = 0; ii < transitions.count(); ++ii) {
+        table.times.append(transitions.at(ii).time().toMSecsSinceEpoch() / 1000);
+        table.offsets.append(transitions.at(ii).phase().utcOffset());
+    }
+
+    return true;
+}
+
+}
+
+QDateTime NemoCalendarLocalZone::toLocal(const KDateTime &dt)
+{
+    if (!dt.isValid())
+        return QDateTime();
+
+    if (dt.isDateOnly())
+        return QDateTime(dt.date(), QTime(0, 0));
+
+    qint64 utcSecs;
+    switch (dt.timeType()) {
+    case KDateTime::ClockTime:
+        // Clock time is local time by definition
+        return QDateTime(dt.date(), dt.time());
+    case KDateTime::UTC:
+    case KDateTime::OffsetFromUTC:
+        utcSecs = QDateTime(dt.date(), dt.time(), Qt::UTC).toMSecsSinceEpoch() / 1000 - dt.utcOffset();
+        break;
+    case KDateTime::TimeZone:
+        if (!table.valid)
+            ensureCovered(QDateTime::currentMSecsSinceEpoch() / 1000);
+        if (table.valid && dt.timeZone().name() == table.zone)
+            return QDateTime(dt.date(), dt.time());
+        // fall through
+    default:
+        return dt.toLocalZone().dateTime();
+    }
+
+    if (!ensureCovered(utcSecs))
+        return dt.toLocalZone().dateTime();
+
+    QVector<qint64>::const_iterator it = qUpperBound(table.times.constBegin(), table.times.constEnd(), utcSecs);
+    int offset = it == table.times.constBegin() ? table.initialOffset
+                                                : table.offsets.at(it - table.times.constBegin() - 1);
+
+    QDateTime local = QDateTime(dt.date(), dt.time(), Qt::UTC).addSecs(offset - dt.utcOffset());
+    return QDateTime(local.date(), local.time());
+}
+
+void NemoCalendarLocalZone::reset()
+{
+    table = TransitionTable();
+}
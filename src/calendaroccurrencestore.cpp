@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+#include "calendaroccurrencestore.h"
+
+#include <QHash>
+#include <QDateTime>
+#include <QtAlgorithms>
+
+#include "calendareventcache.h"
+
+NemoCalendarOccurrenceStore::NemoCalendarOccurrenceStore()
+{
+}
+
+void NemoCalendarOccurrenceStore::clear()
+{
+    mStarts.clear();
+    mEnds.clear();
+    mEventIndexes.clear();
+    mNotebookIds.clear();
+    mFlags.clear();
+    mEvents.clear();
+    mNotebookUids.clear();
+}
+
+bool NemoCalendarOccurrenceStore::lessThan(qint64 start1, const KCalCore::Event::Ptr &event1,
+                                           qint64 start2, const KCalCore::Event::Ptr &event2)
+{
+    if (event1.isNull() != event2.isNull())
+        return event1.data() < event2.data();
+    if (start1 != start2)
+        return start1 < start2;
+    if (!event1)
+        return false;
+
+    int cmp = QString::compare(event1->summary(), event2->summary(), Qt::CaseInsensitive);
+    if (cmp == 0)
+        return QString::compare(event1->uid(), event2->uid()) < 0;
+    return cmp < 0;
+}
+
+// Orders a permutation of the unsorted arrays built by assign()
+struct OccurrenceOrder
+{
+    OccurrenceOrder(const QVector<qint64> &starts, const QVector<int> &eventIndexes, const KCalCore::Event::List &events)
+        : starts(starts), eventIndexes(eventIndexes), events(events)
+    {
+    }
+
+    bool operator()(int lhs, int rhs) const
+    {
+        return NemoCalendarOccurrenceStore::lessThan(starts.at(lhs), events.at(eventIndexes.at(lhs)),
+                                                     starts.at(rhs), events.at(eventIndexes.at(rhs)));
+    }
+
+    const QVector<qint64> &starts;
+    const QVector<int> &eventIndexes;
+    const KCalCore::Event::List &events;
+};
+
+void NemoCalendarOccurrenceStore::assign(const mKCal::ExtendedCalendar::ExpandedIncidenceList &occurrences,
+                                         const QSet<QString> &notebooks)
+{
+    clear();
+
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+
+    // Notebook and flags are looked up once per incidence rather than once
+    // per occurrence; -1 marks incidences left out
+    QHash<const KCalCore::Incidence *, int> eventIndexes;
+    QHash<QString, int> notebookIds;
+    QVector<quint16> eventNotebooks;
+    QVector<quint8> eventFlags;
+
+    QVector<qint64> starts;
+    QVector<qint64> ends;
+    QVector<int> indexes;
+    starts.reserve(occurrences.count());
+    ends.reserve(occurrences.count());
+    indexes.reserve(occurrences.count());
+
+    for (int ii = 0; ii < occurrences.count(); ++ii) {
+        const mKCal::ExtendedCalendar::ExpandedIncidence &occurrence = occurrences.at(ii);
+
+        QHash<const KCalCore::Incidence *, int>::ConstIterator iter = eventIndexes.find(occurrence.second.data());
+        if (iter == eventIndexes.end()) {
+            int index = -1;
+            KCalCore::Event::Ptr event = occurrence.second.dynamicCast<KCalCore::Event>();
+            QString notebook = event ? cache->notebook(event) : QString();
+            if (event && notebooks.contains(notebook)) {
+                QHash<QString, int>::ConstIterator notebookId = notebookIds.find(notebook);
+                if (notebookId == notebookIds.end()) {
+                    notebookId = notebookIds.insert(notebook, mNotebookUids.count());
+                    mNotebookUids.append(notebook);
+                }
+
+                index = mEvents.count();
+                mEvents.append(event);
+                eventNotebooks.append(*notebookId);
+                eventFlags.append((event->allDay() ? AllDayFlag : 0) | (event->recurs() ? RecursFlag : 0));
+            }
+            iter = eventIndexes.insert(occurrence.second.data(), index);
+        }
+
+        if (*iter < 0 || !occurrence.first.dtStart.isValid())
+            continue;
+
+        qint64 start = occurrence.first.dtStart.toMSecsSinceEpoch();
+        starts.append(start);
+        ends.append(occurrence.first.dtEnd.isValid() ? occurrence.first.dtEnd.toMSecsSinceEpoch() : start);
+        indexes.append(*iter);
+    }
+
+    // Sort a permutation, then lay the arrays out in that order
+    QVector<int> order(starts.count());
+    for (int ii = 0; ii < order.count(); ++ii)
+        order[ii] = ii;
+    qSort(order.begin(), order.end(), OccurrenceOrder(starts, indexes, mEvents));
+
+    mStarts.resize(order.count());
+    mEnds.resize(order.count());
+    mEventIndexes.resize(order.count());
+    mNotebookIds.resize(order.count());
+    mFlags.resize(order.count());
+    for (int ii = 0; ii < order.count(); ++ii) {
+        int from = order.at(ii);
+        mStarts[ii] = starts.at(from);
+        mEnds[ii] = ends.at(from);
+        mEventIndexes[ii] = indexes.at(from);
+        mNotebookIds[ii] = eventNotebooks.at(indexes.at(from));
+        mFlags[ii] = eventFlags.at(indexes.at(from));
+    }
+}
+
+QVector<int> NemoCalendarOccurrenceStore::overlapping(const QDate &start, const QDate &end) const
+{
+    QVector<int> rv;
+    if (!start.isValid() || !end.isValid())
+        return rv;
+
+    qint64 from = QDateTime(start, QTime(0, 0)).toMSecsSinceEpoch();
+    qint64 to = QDateTime(end.addDays(1), QTime(0, 0)).toMSecsSinceEpoch();
+
+    const qint64 *starts = mStarts.constData();
+    const qint64 *ends = mEnds.constData();
+    int first = qLowerBound(starts, starts + mStarts.count(), from) - starts;
+    int last = qLowerBound(starts + first, starts + mStarts.count(), to) - starts;
+
+    // Indexes stay in agenda order, as all earlier starts come first
+    for (int ii = 0; ii < first; ++ii) {
+        if (ends[ii] >= from)
+            rv.append(ii);
+    }
+    for (int ii = first; ii < last; ++ii)
+        rv.append(ii);
+
+    return rv;
+}
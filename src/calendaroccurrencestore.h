@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+#ifndef CALENDAROCCURRENCESTORE_H
+#define CALENDAROCCURRENCESTORE_H
+
+#include <QSet>
+#include <QDate>
+#include <QVector>
+#include <QStringList>
+
+// mkcal
+#include <event.h>
+#include <extendedcalendar.h>
+
+// Occurrences expanded for a range of days, held as parallel arrays of start
+// and end times, incidence indexes, notebook ids and flags, so that sorting,
+// filtering and range scans work on contiguous memory.  No QDateTime, shared
+// pointer or object is held per occurrence; agenda models create occurrence
+// objects only for the rows that are asked for.
+class NemoCalendarOccurrenceStore
+{
+public:
+    enum Flag {
+        AllDayFlag = 0x01,
+        RecursFlag = 0x02
+    };
+
+    NemoCalendarOccurrenceStore();
+
+    void clear();
+
+    // Replaces the contents with the occurrences in the given notebooks,
+    // in agenda order
+    void assign(const mKCal::ExtendedCalendar::ExpandedIncidenceList &occurrences, const QSet<QString> &notebooks);
+
+    int count() const { return mStarts.count(); }
+
+    // Times are msecs since the epoch
+    qint64 start(int index) const { return mStarts.at(index); }
+    qint64 end(int index) const { return mEnds.at(index); }
+    const KCalCore::Event::Ptr &event(int index) const { return mEvents.at(mEventIndexes.at(index)); }
+    int notebook(int index) const { return mNotebookIds.at(index); }
+    int flags(int index) const { return mFlags.at(index); }
+
+    QString notebookUid(int id) const { return mNotebookUids.at(id); }
+
+    // The indexes of the occurrences shown by an agenda of the days from
+    // start to end: those starting within the days, and those starting
+    // earlier and lasting into them
+    QVector<int> overlapping(const QDate &start, const QDate &end) const;
+
+    // Agenda order: by start time, then by summary ignoring case, then by uid
+    static bool lessThan(qint64 start1, const KCalCore::Event::Ptr &event1,
+                         qint64 start2, const KCalCore::Event::Ptr &event2);
+
+private:
+    QVector<qint64> mStarts;
+    QVector<qint64> mEnds;
+    QVector<int> mEventIndexes;
+    QVector<quint16> mNotebookIds;      // notebooks are few
+    QVector<quint8> mFlags;
+
+    KCalCore::Event::List mEvents;
+    QStringList mNotebookUids;
+};
+
+#endif // CALENDAROCCURRENCESTORE_H
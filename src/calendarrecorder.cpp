@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarrecorder.h"
+
+#include <QDate>
+
+bool NemoCalendarRecorder::mEnabled = !qgetenv("NEMO_CALENDAR_RECORD").isEmpty();
+
+NemoCalendarRecorder::NemoCalendarRecorder()
+: mNextModelId(0)
+{
+    mFile.setFileName(QString::fromLocal8Bit(qgetenv("NEMO_CALENDAR_RECORD")));
+    if (!mFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("NEMO_CALENDAR_RECORD: cannot write %s", qPrintable(mFile.fileName()));
+        mEnabled = false;
+    }
+    mClock.start();
+}
+
+NemoCalendarRecorder *NemoCalendarRecorder::instance()
+{
+    static NemoCalendarRecorder *recorderInstance;
+    if (!recorderInstance)
+        recorderInstance = new NemoCalendarRecorder;
+
+    return recorderInstance;
+}
+
+void NemoCalendarRecorder::record(const QString &kind, const QStringList &args)
+{
+    if (!mEnabled)
+        return;
+
+    NemoCalendarRecorder *recorder = instance();
+    if (!mEnabled)
+        return;
+
+    QStringList fields;
+    fields << QString::number(recorder->mClock.elapsed()) << kind;
+    for (int ii = 0; ii < args.count(); ++ii)
+        fields << QString(args.at(ii)).replace(QLatin1Char('\t'), QLatin1Char(' ')).replace(QLatin1Char('\n'), QLatin1Char(' '));
+
+    // Flushed per line so that a trace survives the application crashing
+    recorder->mFile.write(fields.join(QLatin1String("\t")).toUtf8() + '\n');
+    recorder->mFile.flush();
+}
+
+void NemoCalendarRecorder::recordAgenda(const void *model, const QDate &start, const QDate &end)
+{
+    if (!mEnabled)
+        return;
+
+    NemoCalendarRecorder *recorder = instance();
+    QHash<const void *, int>::ConstIterator iter = recorder->mModelIds.find(model);
+    if (iter == recorder->mModelIds.end())
+        iter = recorder->mModelIds.insert(model, recorder->mNextModelId++);
+
+    record("agenda", QStringList() << QString::number(*iter)
+                                   << (start.isValid() ? start.toString(Qt::ISODate) : QString("-"))
+                                   << (end.isValid() ? end.toString(Qt::ISODate) : QString("-")));
+}
+
+void NemoCalendarRecorder::recordAgendaDestroyed(const void *model)
+{
+    if (!mEnabled)
+        return;
+
+    NemoCalendarRecorder *recorder = instance();
+    QHash<const void *, int>::Iterator iter = recorder->mModelIds.find(model);
+    if (iter == recorder->mModelIds.end())
+        return;
+
+    int id = *iter;
+    recorder->mModelIds.erase(iter);
+    record("agendaDestroyed", QStringList() << QString::number(id));
+}
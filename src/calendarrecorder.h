@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARRECORDER_H
+#define CALENDARRECORDER_H
+
+#include <QHash>
+#include <QFile>
+#include <QStringList>
+#include <QElapsedTimer>
+
+// Records the inputs that drive the event cache and agenda models, so that
+// a sync pattern seen in the field can be replayed against a test database
+// (see nemocalendar-query's replay command).  Enabled by setting
+// NEMO_CALENDAR_RECORD to the file to write.
+//
+// Each line holds the milliseconds since recording started, the kind of
+// input and its arguments, separated by tabs:
+//
+//   storageModified INFO
+//   agenda ID START END        an agenda model's range changed
+//   agendaDestroyed ID
+//   refresh                    the cache refreshed the pending agenda models
+class NemoCalendarRecorder
+{
+public:
+    static inline bool isEnabled();
+
+    static void record(const QString &kind, const QStringList &args = QStringList());
+    static void recordAgenda(const void *model, const QDate &start, const QDate &end);
+    static void recordAgendaDestroyed(const void *model);
+
+private:
+    NemoCalendarRecorder();
+    static NemoCalendarRecorder *instance();
+
+    static bool mEnabled;
+
+    QFile mFile;
+    QElapsedTimer mClock;
+    QHash<const void *, int> mModelIds;
+    int mNextModelId;
+};
+
+bool NemoCalendarRecorder::isEnabled()
+{
+    return mEnabled;
+}
+
+#endif // CALENDARRECORDER_H
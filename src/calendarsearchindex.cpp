@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarsearchindex.h"
+
+// Relative weight of a token depending on which field it was found in
+enum {
+    SummaryWeight = 4,
+    LocationWeight = 2,
+    DescriptionWeight = 1
+};
+
+// Multiplier applied to the field weight depending on how a query word
+// matched the indexed token
+enum {
+    ExactMatch = 4,
+    PrefixMatch = 2,
+    InfixMatch = 1
+};
+
+NemoCalendarSearchIndex::NemoCalendarSearchIndex()
+: mRevision(0)
+{
+}
+
+// Brings the index up to date with the incidences currently loaded in
+// calendar.  Only events whose revision or modification time differs from
+// the indexed copy are re-tokenized.
+void NemoCalendarSearchIndex::sync(const mKCal::ExtendedCalendar::Ptr &calendar)
+{
+    KCalCore::Event::List events = calendar->rawEvents();
+    QSet<QString> seen;
+
+    for (int ii = 0; ii < events.count(); ++ii) {
+        const KCalCore::Event::Ptr &event = events.at(ii);
+        if (event->hasRecurrenceId())
+            continue;
+
+        seen.insert(event->uid());
+
+        QHash<QString, Entry>::Iterator iter = mEntries.find(event->uid());
+        if (iter != mEntries.end() && iter->revision == event->revision() &&
+            iter->lastModified == event->lastModified()) {
+            if (iter->event != event) {
+                iter->event = event;
+                ++mRevision;
+            }
+        } else {
+            update(event);
+        }
+    }
+
+    QStringList removed;
+    for (QHash<QString, Entry>::ConstIterator iter = mEntries.begin(); iter != mEntries.end(); ++iter) {
+        if (!seen.contains(iter.key()))
+            removed.append(iter.key());
+    }
+
+    for (int ii = 0; ii < removed.count(); ++ii)
+        remove(removed.at(ii));
+}
+
+void NemoCalendarSearchIndex::update(const KCalCore::Event::Ptr &event)
+{
+    if (!event || event->hasRecurrenceId())
+        return;
+
+    QString uid = event->uid();
+    remove(uid);
+
+    Entry entry;
+    entry.event = event;
+    entry.revision = event->revision();
+    entry.lastModified = event->lastModified();
+    addTokens(entry, uid, event->summary(), SummaryWeight);
+    addTokens(entry, uid, event->location(), LocationWeight);
+    addTokens(entry, uid, event->description(), DescriptionWeight);
+
+    mEntries.insert(uid, entry);
+    ++mRevision;
+}
+
+void NemoCalendarSearchIndex::remove(const QString &uid)
+{
+    QHash<QString, Entry>::Iterator iter = mEntries.find(uid);
+    if (iter == mEntries.end())
+        return;
+
+    removeTokens(uid, *iter);
+    mEntries.erase(iter);
+    ++mRevision;
+}
+
+// Changes whenever an event is added, changed or removed, so that users of
+// the index can tell when results they hold may be out of date
+int NemoCalendarSearchIndex::revision() const
+{
+    return mRevision;
+}
+
+// Returns the events matching every word of query, scored by the fields
+// the words were found in and how well they matched.  Each word may be a
+// whole token, a prefix of one, or, if at least three characters long, any
+// part of one.  The result is unordered.
+QList<NemoCalendarSearchIndex::Match> NemoCalendarSearchIndex::search(const QString &query) const
+{
+    QList<Match> rv;
+
+    QStringList words = tokenize(query);
+    words.removeDuplicates();
+    if (words.isEmpty())
+        return rv;
+
+    QList<QHash<QString, int> > wordMatches;
+    int rarest = 0;
+    for (int ii = 0; ii < words.count(); ++ii) {
+        wordMatches.append(matchWord(words.at(ii)));
+        if (wordMatches.last().isEmpty())
+            return rv;
+        if (wordMatches.last().count() < wordMatches.at(rarest).count())
+            rarest = ii;
+    }
+
+    // Walk the shortest candidate list and probe the others
+    const QHash<QString, int> &candidates = wordMatches.at(rarest);
+    for (QHash<QString, int>::ConstIterator iter = candidates.begin(); iter != candidates.end(); ++iter) {
+        int score = 0;
+        int ii = 0;
+        for (; ii < wordMatches.count(); ++ii) {
+            QHash<QString, int>::ConstIterator wordScore = wordMatches.at(ii).find(iter.key());
+            if (wordScore == wordMatches.at(ii).end())
+                break;
+            score += wordScore.value();
+        }
+
+        if (ii == wordMatches.count()) {
+            Match match = { mEntries.value(iter.key()).event, score };
+            rv.append(match);
+        }
+    }
+
+    return rv;
+}
+
+// Scores the candidates, the matches of an earlier query that query
+// narrows, against their own tokens.  Only the events in candidates are
+// visited rather than every token sharing a prefix or trigram with the
+// query words, which keeps each keystroke of a growing query cheap.
+QList<NemoCalendarSearchIndex::Match> NemoCalendarSearchIndex::refine(const QString &query,
+                                                                      const QList<Match> &candidates) const
+{
+    QList<Match> rv;
+
+    QStringList words = tokenize(query);
+    words.removeDuplicates();
+    if (words.isEmpty())
+        return rv;
+
+    for (int ii = 0; ii < candidates.count(); ++ii) {
+        QString uid = candidates.at(ii).event->uid();
+        QHash<QString, Entry>::ConstIterator entry = mEntries.find(uid);
+        if (entry == mEntries.end() || entry->event != candidates.at(ii).event)
+            continue;
+
+        int score = 0;
+        int jj = 0;
+        for (; jj < words.count(); ++jj) {
+            int wordScore = scoreWord(uid, *entry, words.at(jj));
+            if (!wordScore)
+                break;
+            score += wordScore;
+        }
+
+        if (jj == words.count()) {
+            Match match = { entry->event, score };
+            rv.append(match);
+        }
+    }
+
+    return rv;
+}
+
+// Returns whether every event matching query also matches previous, so
+// that query can be answered by refine() from the matches of previous.
+// Each word of previous must be implied by a word of query: the same word,
+// a word containing it if it is long enough to match inside tokens, or a
+// word too short to match inside tokens that it begins.
+bool NemoCalendarSearchIndex::narrows(const QString &query, const QString &previous)
+{
+    QStringList words = tokenize(query);
+    QStringList previousWords = tokenize(previous);
+    if (words.isEmpty() || previousWords.isEmpty())
+        return false;
+
+    for (int ii = 0; ii < previousWords.count(); ++ii) {
+        const QString &previousWord = previousWords.at(ii);
+        int jj = 0;
+        for (; jj < words.count(); ++jj) {
+            const QString &word = words.at(jj);
+            if (word == previousWord)
+                break;
+            if (previousWord.length() >= 3 && word.contains(previousWord))
+                break;
+            if (word.length() < 3 && word.startsWith(previousWord))
+                break;
+        }
+        if (jj == words.count())
+            return false;
+    }
+
+    return true;
+}
+
+// Returns uid -> score for all events with a token matching word
+QHash<QString, int> NemoCalendarSearchIndex::matchWord(const QString &word) const
+{
+    QHash<QString, int> rv;
+
+    QMap<QString, QHash<QString, int> >::ConstIterator iter = mPostings.lowerBound(word);
+    for (; iter != mPostings.end() && iter.key().startsWith(word); ++iter) {
+        int multiplier = iter.key().length() == word.length()?ExactMatch:PrefixMatch;
+        for (QHash<QString, int>::ConstIterator posting = iter->begin(); posting != iter->end(); ++posting) {
+            int &score = rv[posting.key()];
+            score = qMax(score, posting.value() * multiplier);
+        }
+    }
+
+    QStringList wordTrigrams = trigrams(word);
+    if (wordTrigrams.isEmpty())
+        return rv;
+
+    QSet<QString> tokens = mTrigrams.value(wordTrigrams.at(0));
+    for (int ii = 1; ii < wordTrigrams.count() && !tokens.isEmpty(); ++ii)
+        tokens.intersect(mTrigrams.value(wordTrigrams.at(ii)));
+
+    for (QSet<QString>::ConstIterator token = tokens.begin(); token != tokens.end(); ++token) {
+        // Prefix matches were handled above; trigrams alone may also give
+        // false positives
+        if (token->startsWith(word) || !token->contains(word))
+            continue;
+
+        const QHash<QString, int> &postings = mPostings[*token];
+        for (QHash<QString, int>::ConstIterator posting = postings.begin(); posting != postings.end(); ++posting) {
+            int &score = rv[posting.key()];
+            score = qMax(score, posting.value() * InfixMatch);
+        }
+    }
+
+    return rv;
+}
+
+// Returns the best score of word against the tokens of entry, as
+// matchWord() would give it, or 0 if none match
+int NemoCalendarSearchIndex::scoreWord(const QString &uid, const Entry &entry, const QString &word) const
+{
+    int rv = 0;
+    for (int ii = 0; ii < entry.tokens.count(); ++ii) {
+        const QString &token = entry.tokens.at(ii);
+        int multiplier;
+        if (token.startsWith(word))
+            multiplier = token.length() == word.length()?ExactMatch:PrefixMatch;
+        else if (word.length() >= 3 && token.contains(word))
+            multiplier = InfixMatch;
+        else
+            continue;
+
+        QMap<QString, QHash<QString, int> >::ConstIterator postings = mPostings.find(token);
+        if (postings != mPostings.end())
+            rv = qMax(rv, postings->value(uid) * multiplier);
+    }
+
+    return rv;
+}
+
+// Splits text into case folded words
+QStringList NemoCalendarSearchIndex::tokenize(const QString &text)
+{
+    QStringList rv;
+    QString token;
+
+    for (int ii = 0; ii < text.length(); ++ii) {
+        QChar c = text.at(ii);
+        if (c.isLetterOrNumber()) {
+            token.append(c.toCaseFolded());
+        } else if (!token.isEmpty()) {
+            rv.append(token);
+            token.clear();
+        }
+    }
+
+    if (!token.isEmpty())
+        rv.append(token);
+
+    return rv;
+}
+
+QStringList NemoCalendarSearchIndex::trigrams(const QString &token)
+{
+    QStringList rv;
+    for (int ii = 0; ii + 3 <= token.length(); ++ii)
+        rv.append(token.mid(ii, 3));
+    return rv;
+}
+
+void NemoCalendarSearchIndex::calendarIncidenceAdded(const KCalCore::Incidence::Ptr &incidence)
+{
+    update(incidence.dynamicCast<KCalCore::Event>());
+}
+
+void NemoCalendarSearchIndex::calendarIncidenceChanged(const KCalCore::Incidence::Ptr &incidence)
+{
+    update(incidence.dynamicCast<KCalCore::Event>());
+}
+
+void NemoCalendarSearchIndex::calendarIncidenceDeleted(const KCalCore::Incidence::Ptr &incidence)
+{
+    if (incidence && !incidence->hasRecurrenceId())
+        remove(incidence->uid());
+}
+
+void NemoCalendarSearchIndex::addTokens(Entry &entry, const QString &uid, const QString &text, int weight)
+{
+    QStringList tokens = tokenize(text);
+    for (int ii = 0; ii < tokens.count(); ++ii) {
+        const QString &token = tokens.at(ii);
+        QMap<QString, QHash<QString, int> >::Iterator iter = mPostings.find(token);
+        if (iter == mPostings.end()) {
+            iter = mPostings.insert(token, QHash<QString, int>());
+
+            QStringList tokenTrigrams = trigrams(token);
+            for (int jj = 0; jj < tokenTrigrams.count(); ++jj)
+                mTrigrams[tokenTrigrams.at(jj)].insert(token);
+        }
+
+        (*iter)[uid] += weight;
+        entry.tokens.append(token);
+    }
+}
+
+void NemoCalendarSearchIndex::removeTokens(const QString &uid, const Entry &entry)
+{
+    for (int ii = 0; ii < entry.tokens.count(); ++ii) {
+        const QString &token = entry.tokens.at(ii);
+        QMap<QString, QHash<QString, int> >::Iterator iter = mPostings.find(token);
+        if (iter == mPostings.end())
+            continue;
+
+        iter->remove(uid);
+        if (!iter->isEmpty())
+            continue;
+
+        mPostings.erase(iter);
+
+        QStringList tokenTrigrams = trigrams(token);
+        for (int jj = 0; jj < tokenTrigrams.count(); ++jj) {
+            QHash<QString, QSet<QString> >::Iterator trigram = mTrigrams.find(tokenTrigrams.at(jj));
+            if (trigram == mTrigrams.end())
+                continue;
+            trigram->remove(token);
+            if (trigram->isEmpty())
+                mTrigrams.erase(trigram);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARSEARCHINDEX_H
+#define CALENDARSEARCHINDEX_H
+
+#include <QMap>
+#include <QSet>
+#include <QHash>
+#include <QStringList>
+
+// mkcal
+#include <event.h>
+#include <extendedcalendar.h>
+
+class NemoCalendarSearchIndex : public KCalCore::Calendar::CalendarObserver
+{
+public:
+    struct Match {
+        KCalCore::Event::Ptr event;
+        int score;
+    };
+
+    NemoCalendarSearchIndex();
+
+    void sync(const mKCal::ExtendedCalendar::Ptr &calendar);
+    void update(const KCalCore::Event::Ptr &event);
+    void remove(const QString &uid);
+
+    int revision() const;
+
+    QList<Match> search(const QString &query) const;
+    QList<Match> refine(const QString &query, const QList<Match> &candidates) const;
+
+    static bool narrows(const QString &query, const QString &previous);
+
+    static QStringList tokenize(const QString &text);
+
+    /* KCalCore::Calendar::CalendarObserver */
+    void calendarIncidenceAdded(const KCalCore::Incidence::Ptr &incidence);
+    void calendarIncidenceChanged(const KCalCore::Incidence::Ptr &incidence);
+    void calendarIncidenceDeleted(const KCalCore::Incidence::Ptr &incidence);
+
+private:
+    struct Entry {
+        KCalCore::Event::Ptr event;
+        int revision;
+        KDateTime lastModified;
+        QStringList tokens;
+    };
+
+    void addTokens(Entry &, const QString &uid, const QString &text, int weight);
+    void removeTokens(const QString &uid, const Entry &);
+    QHash<QString, int> matchWord(const QString &word) const;
+    int scoreWord(const QString &uid, const Entry &, const QString &word) const;
+
+    static QStringList trigrams(const QString &token);
+
+    QHash<QString, Entry> mEntries;
+    // token -> (uid -> weight), ordered so that prefixes can be enumerated
+    QMap<QString, QHash<QString, int> > mPostings;
+    // trigram -> tokens containing it
+    QHash<QString, QSet<QString> > mTrigrams;
+    int mRevision;
+};
+
+#endif // CALENDARSEARCHINDEX_H
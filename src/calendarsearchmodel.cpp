@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarsearchmodel.h"
+
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QVector>
+
+#include <algorithm>
+
+#include "calendardb.h"
+#include "calendarevent.h"
+#include "calendareventcache.h"
+#include "calendarlocalzone.h"
+#include "calendarstats.h"
+
+// Time in milliseconds spent adding results before yielding to the event
+// loop, so that typing stays responsive however many events match
+static const int EvaluationBudget = 4;
+
+NemoCalendarSearchModel::NemoCalendarSearchModel(QObject *parent)
+: QAbstractListModel(parent), mIsComplete(true), mEvaluationEventSent(false), mSearchPending(false),
+  mIndexRevision(-1)
+{
+    mRoleNames[EventObjectRole] = "event";
+    mRoleNames[OccurrenceObjectRole] = "occurrence";
+    mRoleNames[SectionBucketRole] = "sectionBucket";
+
+    connect(NemoCalendarEventCache::instance(), SIGNAL(modelReset()), this, SLOT(storageChanged()));
+}
+
+NemoCalendarSearchModel::~NemoCalendarSearchModel()
+{
+    for (int ii = 0; ii < mResults.count(); ++ii)
+        delete mResults.at(ii).occurrence;
+}
+
+QHash<int, QByteArray> NemoCalendarSearchModel::roleNames() const
+{
+    return mRoleNames;
+}
+
+// The text to search for.  An event matches if every word appears in its
+// summary, location or description, either whole or as part of a longer
+// word, so the model can be bound directly to a search field.
+QString NemoCalendarSearchModel::searchString() const
+{
+    return mSearchString;
+}
+
+void NemoCalendarSearchModel::setSearchString(const QString &searchString)
+{
+    if (mSearchString == searchString)
+        return;
+
+    mSearchString = searchString;
+    emit searchStringChanged();
+
+    refresh();
+}
+
+int NemoCalendarSearchModel::count() const
+{
+    return mResults.count();
+}
+
+int NemoCalendarSearchModel::rowCount(const QModelIndex &index) const
+{
+    if (index != QModelIndex())
+        return 0;
+
+    return mResults.count();
+}
+
+QVariant NemoCalendarSearchModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mResults.count())
+        return QVariant();
+
+    NemoCalendarEventOccurrence *occurrence = mResults.at(index.row()).occurrence;
+
+    switch (role) {
+        case EventObjectRole:
+            return QVariant::fromValue<QObject *>(occurrence->eventObject());
+        case OccurrenceObjectRole:
+            return QVariant::fromValue<QObject *>(occurrence);
+        case SectionBucketRole:
+            return occurrence->startTime().date();
+        default:
+            return QVariant();
+    }
+}
+
+void NemoCalendarSearchModel::classBegin()
+{
+    mIsComplete = false;
+}
+
+void NemoCalendarSearchModel::componentComplete()
+{
+    mIsComplete = true;
+    refresh();
+}
+
+bool NemoCalendarSearchModel::event(QEvent *e)
+{
+    if (e->type() == QEvent::User) {
+        mEvaluationEventSent = false;
+        if (mSearchPending)
+            search();
+        evaluate();
+    }
+    return QAbstractListModel::event(e);
+}
+
+static bool matchLessThan(const NemoCalendarSearchIndex::Match &m1, const NemoCalendarSearchIndex::Match &m2)
+{
+    return m1.score < m2.score;
+}
+
+// Results are ranked by relevance first and by distance from the start of
+// today second
+bool NemoCalendarSearchModel::resultLessThan(const Result &r1, const Result &r2)
+{
+    if (r1.score != r2.score)
+        return r1.score > r2.score;
+    else if (r1.distance != r2.distance)
+        return r1.distance < r2.distance;
+    else
+        return r1.occurrence->startTime() < r2.occurrence->startTime();
+}
+
+// Returns the first occurrence of event starting at or after from, or the
+// last one before it if the event has no later occurrences.
+static mKCal::ExtendedCalendar::ExpandedIncidenceValidity nearestOccurrence(const KCalCore::Event::Ptr &event,
+                                                                            const KDateTime &from)
+{
+    mKCal::ExtendedCalendar::ExpandedIncidenceValidity eiv = {
+        NemoCalendarLocalZone::toLocal(event->dtStart()),
+        NemoCalendarLocalZone::toLocal(event->dtEnd())
+    };
+
+    if (event->recurs()) {
+        KCalCore::Recurrence *recurrence = event->recurrence();
+        KDateTime match = recurrence->recursAt(from)?from:recurrence->getNextDateTime(from);
+        if (match.isNull())
+            match = recurrence->getPreviousDateTime(from);
+
+        if (!match.isNull()) {
+            eiv.dtStart = NemoCalendarLocalZone::toLocal(match);
+            eiv.dtEnd = NemoCalendarLocalZone::toLocal(KCalCore::Duration(event->dtStart(), event->dtEnd()).end(match));
+        }
+    }
+
+    return eiv;
+}
+
+// Starts a new search, abandoning any results of the previous search that
+// have not been added yet.  The search itself runs from the event loop, so
+// keystrokes arriving together cost a single search.
+void NemoCalendarSearchModel::refresh()
+{
+    if (!mIsComplete)
+        return;
+
+    mSearchPending = true;
+    if (!mEvaluationEventSent) {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+        mEvaluationEventSent = true;
+    }
+}
+
+// Reloads that leave the search index and the visible notebooks as they
+// were cannot change the results.  Otherwise the search runs again and the
+// rows are updated from its matches.
+void NemoCalendarSearchModel::storageChanged()
+{
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    if (mIndexRevision == cache->mSearchIndex.revision() && mIndexNotebooks == cache->mNotebooks)
+        return;
+
+    // The matches kept for refining may refer to changed or removed events
+    mMatchedString.clear();
+    mMatches.clear();
+    refresh();
+}
+
+void NemoCalendarSearchModel::search()
+{
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    cache->ensureLoaded();
+    mSearchPending = false;
+
+    // A string that narrows the last one only needs its matches rescored
+    if (!mMatchedString.isEmpty() && NemoCalendarSearchIndex::narrows(mSearchString, mMatchedString))
+        mMatches = cache->mSearchIndex.refine(mSearchString, mMatches);
+    else
+        mMatches = cache->mSearchIndex.search(mSearchString);
+    mMatchedString = mSearchString;
+    mIndexRevision = cache->mSearchIndex.revision();
+    mIndexNotebooks = cache->mNotebooks;
+
+    // The rows shown stay valid for a search of the same string on the same
+    // day, as the distances they are ordered by are from the start of today
+    KDateTime today(QDate::currentDate(), QTime(0, 0), KDateTime::Spec(KDateTime::LocalZone));
+    bool update = mSearchString == mResultsString && today == mToday;
+    mResultsString = mSearchString;
+    mToday = today;
+
+    mPending = mMatches;
+    if (update) {
+        updateResults();
+    } else if (!mResults.isEmpty()) {
+        beginResetModel();
+        for (int ii = 0; ii < mResults.count(); ++ii)
+            delete mResults.at(ii).occurrence;
+        mResults.clear();
+        endResetModel();
+        emit countChanged();
+    }
+
+    // Evaluating the best matches first means later batches mostly append.
+    // Building a heap is linear; each match is taken off it as it is added.
+    std::make_heap(mPending.begin(), mPending.end(), matchLessThan);
+}
+
+// Brings the rows up to date with the matches of a search that has run
+// again after a storage change.  Rows whose event no longer matches are
+// removed, and rows whose event changed are updated where they stand if
+// they still sort there.  Everything else is left to evaluate(), which
+// only sees the matches not shown yet.
+void NemoCalendarSearchModel::updateResults()
+{
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    int oldResultCount = mResults.count();
+
+    QHash<QString, int> matchIndexes;
+    for (int ii = 0; ii < mPending.count(); ++ii)
+        matchIndexes.insert(mPending.at(ii).event->uid(), ii);
+    QVector<bool> shown(mPending.count(), false);
+
+    for (int row = mResults.count() - 1; row >= 0; --row) {
+        QHash<QString, int>::ConstIterator iter = matchIndexes.find(mResults.at(row).event->uid());
+        if (iter == matchIndexes.end()
+                || !cache->mNotebooks.contains(calendar->notebook(mPending.at(*iter).event))) {
+            removeResult(row);
+            continue;
+        }
+
+        const NemoCalendarSearchIndex::Match &match = mPending.at(*iter);
+        const Result &result = mResults.at(row);
+        if (match.event == result.event && match.score == result.score
+                && match.event->revision() == result.revision
+                && match.event->lastModified() == result.lastModified) {
+            shown[*iter] = true;
+            continue;
+        }
+
+        Result updated = createResult(match);
+        if ((row == 0 || !resultLessThan(updated, mResults.at(row - 1)))
+                && (row == mResults.count() - 1 || !resultLessThan(mResults.at(row + 1), updated))) {
+            delete result.occurrence;
+            mResults[row] = updated;
+            shown[*iter] = true;
+            emit dataChanged(index(row), index(row));
+        } else {
+            // Added again in its new position by evaluate()
+            delete updated.occurrence;
+            removeResult(row);
+        }
+    }
+
+    QList<NemoCalendarSearchIndex::Match> pending;
+    for (int ii = 0; ii < mPending.count(); ++ii) {
+        if (!shown.at(ii))
+            pending.append(mPending.at(ii));
+    }
+    mPending = pending;
+
+    if (oldResultCount != mResults.count())
+        emit countChanged();
+}
+
+NemoCalendarSearchModel::Result NemoCalendarSearchModel::createResult(const NemoCalendarSearchIndex::Match &match)
+{
+    Result result;
+    result.occurrence = new NemoCalendarEventOccurrence(
+            qMakePair(nearestOccurrence(match.event, mToday), match.event.dynamicCast<KCalCore::Incidence>()),
+            this);
+    result.event = match.event;
+    result.revision = match.event->revision();
+    result.lastModified = match.event->lastModified();
+    result.score = match.score;
+    result.distance = qAbs(mToday.dateTime().secsTo(result.occurrence->startTime()));
+    return result;
+}
+
+void NemoCalendarSearchModel::removeResult(int row)
+{
+    beginRemoveRows(QModelIndex(), row, row);
+    delete mResults.takeAt(row).occurrence;
+    endRemoveRows();
+    NemoCalendarStats::count(NemoCalendarStats::RowsRemoved);
+}
+
+// Adds pending matches to the model, in sorted position, until the time
+// budget runs out.  The remainder is continued from the event loop.
+void NemoCalendarSearchModel::evaluate()
+{
+    if (mPending.isEmpty())
+        return;
+
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    int oldResultCount = mResults.count();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!mPending.isEmpty() && timer.elapsed() < EvaluationBudget) {
+        std::pop_heap(mPending.begin(), mPending.end(), matchLessThan);
+        NemoCalendarSearchIndex::Match match = mPending.takeLast();
+        if (!cache->mNotebooks.contains(calendar->notebook(match.event)))
+            continue;
+
+        Result result = createResult(match);
+        int row = qUpperBound(mResults.begin(), mResults.end(), result, resultLessThan) - mResults.begin();
+        beginInsertRows(QModelIndex(), row, row);
+        mResults.insert(row, result);
+        endInsertRows();
+        NemoCalendarStats::count(NemoCalendarStats::RowsInserted);
+    }
+
+    if (!mPending.isEmpty() && !mEvaluationEventSent) {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+        mEvaluationEventSent = true;
+    }
+
+    if (oldResultCount != mResults.count())
+        emit countChanged();
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARSEARCHMODEL_H
+#define CALENDARSEARCHMODEL_H
+
+#include <QAbstractListModel>
+#include <QQmlParserStatus>
+
+#include "calendarsearchindex.h"
+
+class NemoCalendarEventOccurrence;
+
+class NemoCalendarSearchModel : public QAbstractListModel, public QQmlParserStatus
+{
+    Q_OBJECT
+    Q_INTERFACES(QQmlParserStatus)
+    Q_PROPERTY(QString searchString READ searchString WRITE setSearchString NOTIFY searchStringChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    enum {
+        EventObjectRole = Qt::UserRole,
+        OccurrenceObjectRole,
+        SectionBucketRole
+    };
+
+    explicit NemoCalendarSearchModel(QObject *parent = 0);
+    virtual ~NemoCalendarSearchModel();
+
+    QString searchString() const;
+    void setSearchString(const QString &);
+
+    int count() const;
+
+    virtual int rowCount(const QModelIndex &index) const;
+    virtual QVariant data(const QModelIndex &index, int role) const;
+
+    virtual void classBegin();
+    virtual void componentComplete();
+
+signals:
+    void searchStringChanged();
+    void countChanged();
+
+protected:
+    virtual QHash<int, QByteArray> roleNames() const;
+    virtual bool event(QEvent *);
+
+private slots:
+    void refresh();
+    void storageChanged();
+
+private:
+    struct Result {
+        NemoCalendarEventOccurrence *occurrence;
+        KCalCore::Event::Ptr event;
+        int revision;
+        KDateTime lastModified;
+        int score;
+        qint64 distance;
+    };
+
+    static bool resultLessThan(const Result &, const Result &);
+    Result createResult(const NemoCalendarSearchIndex::Match &match);
+    void removeResult(int row);
+    void search();
+    void updateResults();
+    void evaluate();
+
+    bool mIsComplete:1;
+    bool mEvaluationEventSent:1;
+    bool mSearchPending:1;
+    QString mSearchString;
+    QString mResultsString;
+    QList<Result> mResults;
+    QHash<int, QByteArray> mRoleNames;
+
+    // Matches of the current search string not yet added to mResults, as a
+    // heap with the best match on top
+    QList<NemoCalendarSearchIndex::Match> mPending;
+    KDateTime mToday;
+
+    // All matches of the last string searched, which a longer string can
+    // be refined from
+    QString mMatchedString;
+    QList<NemoCalendarSearchIndex::Match> mMatches;
+
+    // State of the cache the last search ran against
+    int mIndexRevision;
+    QSet<QString> mIndexNotebooks;
+};
+
+#endif // CALENDARSEARCHMODEL_H
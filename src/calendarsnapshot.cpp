@@ -0,0 +1,666 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+#include "calendarsnapshot.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// kdepimlibs
+#include <ksystemtimezone.h>
+
+// mkcal
+#include <sqlitestorage.h>
+
+#include "calendardb.h"
+#include "calendarlocalzone.h"
+
+// The file is a header followed by arrays of rows, events, notebooks and
+// the strings they refer to, in host byte order and padded so that every
+// array is naturally aligned when mapped.
+
+static const quint32 SnapshotMagic = 0x4e43534e;
+static const quint32 SnapshotVersion = 1;
+
+struct NemoCalendarSnapshot::Header {
+    quint32 magic;
+    quint32 version;
+    qint64 inode;
+    qint64 size;
+    qint64 modified;
+    qint32 startDay;        // julian days
+    qint32 endDay;
+    quint32 database;       // string offsets
+    quint32 zone;
+    quint32 rowCount;
+    quint32 eventCount;
+    quint32 notebookCount;
+    quint32 stringBytes;
+};
+
+// One occurrence, sorted by start time
+struct NemoCalendarSnapshot::Row {
+    qint64 start;           // msecs since the epoch
+    qint64 end;
+    quint32 event;          // index into the events
+    quint32 reserved;
+};
+
+struct NemoCalendarSnapshot::EventRecord {
+    qint64 start;           // msecs since the epoch
+    qint64 end;
+    quint32 uid;            // string offsets
+    quint32 summary;
+    quint32 location;
+    quint32 notebook;       // index into the notebooks
+    quint32 flags;
+    quint32 reserved;
+};
+
+struct NemoCalendarSnapshot::NotebookRecord {
+    quint32 uid;            // string offsets
+    quint32 color;
+};
+
+enum {
+    AllDayFlag = 0x1,
+    NoEndFlag = 0x2
+};
+
+NemoCalendarSnapshot::Stamp::Stamp()
+: inode(0), size(0), modified(0)
+{
+}
+
+bool NemoCalendarSnapshot::Stamp::isValid() const
+{
+    return !database.isEmpty();
+}
+
+bool NemoCalendarSnapshot::Stamp::operator==(const Stamp &other) const
+{
+    return database == other.database && zone == other.zone && inode == other.inode &&
+           size == other.size && modified == other.modified;
+}
+
+NemoCalendarSnapshot::NemoCalendarSnapshot()
+: mData(0), mDataSize(0), mShared(false), mHeader(0), mRows(0), mEvents(0), mNotebooks(0), mStrings(0)
+{
+}
+
+NemoCalendarSnapshot::~NemoCalendarSnapshot()
+{
+    close();
+}
+
+bool NemoCalendarSnapshot::isEnabled()
+{
+    static const bool enabled = qgetenv("NEMO_CALENDAR_SNAPSHOT") != "0";
+    return enabled;
+}
+
+NemoCalendarSnapshot::Stamp NemoCalendarSnapshot::currentStamp()
+{
+    Stamp stamp;
+
+    mKCal::SqliteStorage *storage = dynamic_cast<mKCal::SqliteStorage *>(NemoCalendarDb::storage().data());
+    if (!storage)
+        return stamp;
+
+    QString database = storage->databaseName();
+    struct stat st;
+    if (::stat(QFile::encodeName(database).constData(), &st) != 0)
+        return stamp;
+
+    stamp.database = database;
+    stamp.zone = KSystemTimeZones::local().name();
+    stamp.inode = st.st_ino;
+    stamp.size = st.st_size;
+    stamp.modified = qint64(st.st_mtim.tv_sec) * Q_INT64_C(1000000000) + st.st_mtim.tv_nsec;
+    return stamp;
+}
+
+QString NemoCalendarSnapshot::fileName(const Stamp &stamp)
+{
+    return QDir::homePath() + QLatin1String("/.cache/nemo-qml-plugin-calendar/agenda-") +
+           QString::number(qHash(stamp.database), 16) + QLatin1String(".snapshot");
+}
+
+// Maps the snapshot written for the database identified by stamp.  Fails if
+// there is none, or if it was written from a different state of it.
+bool NemoCalendarSnapshot::open(const Stamp &stamp)
+{
+    close();
+
+    if (!stamp.isValid())
+        return false;
+
+    mFile.setFileName(fileName(stamp));
+    if (!mFile.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = mFile.size();
+    const uchar *data = size >= qint64(sizeof(Header)) ? mFile.map(0, size) : 0;
+    if (!data || !attach(data, size, false, stamp)) {
+        if (data && !mData)
+            mFile.unmap(const_cast<uchar *>(data));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+// Maps the occurrence index published by another process for the database
+// identified by stamp.  The current contents are kept if the published
+// index is missing or was built from another state of the database.
+//
+// Shared memory names are visible to every user, so a segment is only
+// trusted if it belongs to this user and nobody else can write to it.
+bool NemoCalendarSnapshot::openShared(const Stamp &stamp)
+{
+    if (!stamp.isValid())
+        return false;
+
+    int fd = shm_open(sharedName(stamp).constData(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_uid != geteuid() || (st.st_mode & 0777) != 0600) {
+        qWarning() << "Ignoring shared calendar index not owned by this user" << sharedName(stamp);
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size >= qint64(sizeof(Header)))
+        data = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    const Header *header = static_cast<const Header *>(data);
+    if (header->magic != SnapshotMagic || header->inode != stamp.inode || header->size != stamp.size ||
+        header->modified != stamp.modified) {
+        munmap(data, st.st_size);
+        return false;
+    }
+
+    close();
+    if (!attach(static_cast<const uchar *>(data), st.st_size, true, stamp)) {
+        if (!mData)
+            munmap(data, st.st_size);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool NemoCalendarSnapshot::attach(const uchar *data, qint64 size, bool shared, const Stamp &stamp)
+{
+    const Header *header = reinterpret_cast<const Header *>(data);
+    if (header->magic != SnapshotMagic)
+        return false;
+
+    // Pairs with the barrier in publish(), which sets the magic last
+    __sync_synchronize();
+
+    qint64 expectedSize = sizeof(Header) + qint64(header->rowCount) * sizeof(Row) +
+                          qint64(header->eventCount) * sizeof(EventRecord) +
+                          qint64(header->notebookCount) * sizeof(NotebookRecord) + header->stringBytes;
+    if (header->version != SnapshotVersion || size != expectedSize)
+        return false;
+
+    mData = data;
+    mDataSize = size;
+    mShared = shared;
+    mHeader = header;
+    mRows = reinterpret_cast<const Row *>(mData + sizeof(Header));
+    mEvents = reinterpret_cast<const EventRecord *>(mRows + header->rowCount);
+    mNotebooks = reinterpret_cast<const NotebookRecord *>(mEvents + header->eventCount);
+    mStrings = reinterpret_cast<const uchar *>(mNotebooks + header->notebookCount);
+
+    if (header->inode != stamp.inode || header->size != stamp.size || header->modified != stamp.modified ||
+        string(header->database) != stamp.database || string(header->zone) != stamp.zone)
+        return false;
+
+    for (quint32 ii = 0; ii < header->rowCount; ++ii) {
+        if (mRows[ii].event >= header->eventCount)
+            return false;
+    }
+    for (quint32 ii = 0; ii < header->eventCount; ++ii) {
+        if (mEvents[ii].notebook >= header->notebookCount)
+            return false;
+    }
+
+    mPlaceholders.resize(header->eventCount);
+    return true;
+}
+
+void NemoCalendarSnapshot::close()
+{
+    if (mData && mShared)
+        munmap(const_cast<uchar *>(mData), mDataSize);
+    else if (mData)
+        mFile.unmap(const_cast<uchar *>(mData));
+    mFile.close();
+
+    mData = 0;
+    mDataSize = 0;
+    mShared = false;
+    mHeader = 0;
+    mRows = 0;
+    mEvents = 0;
+    mNotebooks = 0;
+    mStrings = 0;
+
+    mPlaceholders.clear();
+    mPlaceholderNotebooks.clear();
+    mPlaceholderIndexes.clear();
+}
+
+QDate NemoCalendarSnapshot::startDate() const
+{
+    return mHeader ? QDate::fromJulianDay(mHeader->startDay) : QDate();
+}
+
+QDate NemoCalendarSnapshot::endDate() const
+{
+    return mHeader ? QDate::fromJulianDay(mHeader->endDay) : QDate();
+}
+
+bool NemoCalendarSnapshot::covers(const QDate &start, const QDate &end) const
+{
+    return mHeader && start.isValid() && end.isValid() && start >= startDate() && end <= endDate();
+}
+
+QStringList NemoCalendarSnapshot::notebooks() const
+{
+    QStringList rv;
+    for (quint32 ii = 0; mHeader && ii < mHeader->notebookCount; ++ii)
+        rv.append(string(mNotebooks[ii].uid));
+    return rv;
+}
+
+QHash<QString, QString> NemoCalendarSnapshot::notebookColors() const
+{
+    QHash<QString, QString> rv;
+    for (quint32 ii = 0; mHeader && ii < mHeader->notebookCount; ++ii)
+        rv.insert(string(mNotebooks[ii].uid), string(mNotebooks[ii].color));
+    return rv;
+}
+
+mKCal::ExtendedCalendar::ExpandedIncidenceList NemoCalendarSnapshot::occurrences(const QDate &start, const QDate &end)
+{
+    mKCal::ExtendedCalendar::ExpandedIncidenceList rv;
+
+    for (quint32 ii = 0; mHeader && ii < mHeader->rowCount; ++ii) {
+        const Row &row = mRows[ii];
+        QDateTime dtStart = QDateTime::fromMSecsSinceEpoch(row.start);
+        if (dtStart.date() > end)
+            break;
+
+        QDateTime dtEnd = QDateTime::fromMSecsSinceEpoch(row.end);
+        if (dtEnd.date() < start)
+            continue;
+
+        mKCal::ExtendedCalendar::ExpandedIncidenceValidity validity = { dtStart, dtEnd };
+        rv.append(qMakePair(validity, KCalCore::Incidence::Ptr(placeholder(row.event))));
+    }
+
+    return rv;
+}
+
+QString NemoCalendarSnapshot::notebook(const KCalCore::Incidence::Ptr &incidence) const
+{
+    QHash<const KCalCore::Incidence *, quint32>::ConstIterator iter = mPlaceholderNotebooks.find(incidence.data());
+    if (iter == mPlaceholderNotebooks.end())
+        return QString();
+
+    return string(mNotebooks[*iter].uid);
+}
+
+QString NemoCalendarSnapshot::string(quint32 offset) const
+{
+    if (!mHeader || qint64(offset) + 4 > mHeader->stringBytes)
+        return QString();
+
+    quint32 length = *reinterpret_cast<const quint32 *>(mStrings + offset);
+    if (qint64(offset) + 4 + qint64(length) * 2 > mHeader->stringBytes)
+        return QString();
+
+    return QString(reinterpret_cast<const QChar *>(mStrings + offset + 4), length);
+}
+
+// Placeholder events are created when first served and shared by all the
+// occurrences of the event.  They are read only; wrappers load the storage
+// before reading any other field or making changes.
+KCalCore::Event::Ptr NemoCalendarSnapshot::placeholder(quint32 index)
+{
+    KCalCore::Event::Ptr &event = mPlaceholders[index];
+    if (event)
+        return event;
+
+    const EventRecord &record = mEvents[index];
+    KDateTime::Spec spec = KDateTime::Spec(KDateTime::LocalZone);
+
+    event = KCalCore::Event::Ptr(new KCalCore::Event);
+    event->setUid(string(record.uid));
+    event->setSummary(string(record.summary));
+    event->setLocation(string(record.location));
+    event->setDtStart(KDateTime(QDateTime::fromMSecsSinceEpoch(record.start), spec));
+    if (!(record.flags & NoEndFlag))
+        event->setDtEnd(KDateTime(QDateTime::fromMSecsSinceEpoch(record.end), spec));
+    event->setAllDay(record.flags & AllDayFlag);
+    event->setReadOnly(true);
+
+    mPlaceholderNotebooks.insert(event.data(), record.notebook);
+    return event;
+}
+
+static quint32 addString(QByteArray &strings, QHash<QString, quint32> &offsets, const QString &string)
+{
+    QHash<QString, quint32>::ConstIterator iter = offsets.find(string);
+    if (iter != offsets.end())
+        return *iter;
+
+    quint32 offset = strings.size();
+    quint32 length = string.length();
+    strings.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    strings.append(reinterpret_cast<const char *>(string.constData()), length * sizeof(QChar));
+    if (strings.size() % 4)
+        strings.append(QByteArray(4 - strings.size() % 4, '\0'));
+
+    offsets.insert(string, offset);
+    return offset;
+}
+
+static bool occurrenceLessThan(const mKCal::ExtendedCalendar::ExpandedIncidence &lhs,
+                               const mKCal::ExtendedCalendar::ExpandedIncidence &rhs)
+{
+    return lhs.first.dtStart < rhs.first.dtStart;
+}
+
+template<typename T>
+static void appendRecords(QByteArray &data, const QVector<T> &records)
+{
+    data.append(reinterpret_cast<const char *>(records.constData()), records.count() * sizeof(T));
+}
+
+// Lays out the occurrences expanded for the days from start to end, for
+// write() or publish()
+QByteArray NemoCalendarSnapshot::build(const Stamp &stamp, const QDate &start, const QDate &end,
+                                       const mKCal::ExtendedCalendar::ExpandedIncidenceList &occurrences,
+                                       const mKCal::ExtendedCalendar::Ptr &calendar,
+                                       const QHash<QString, QString> &notebookColors)
+{
+    mKCal::ExtendedCalendar::ExpandedIncidenceList sorted = occurrences;
+    qStableSort(sorted.begin(), sorted.end(), occurrenceLessThan);
+
+    QByteArray strings;
+    QHash<QString, quint32> stringOffsets;
+    QVector<Row> rows;
+    QVector<EventRecord> events;
+    QVector<NotebookRecord> notebooks;
+    QHash<const KCalCore::Incidence *, quint32> eventIndexes;
+    QHash<QString, quint32> notebookIndexes;
+
+    for (int ii = 0; ii < sorted.count(); ++ii) {
+        const mKCal::ExtendedCalendar::ExpandedIncidence &occurrence = sorted.at(ii);
+        KCalCore::Event::Ptr event = occurrence.second.dynamicCast<KCalCore::Event>();
+        if (!event || !occurrence.first.dtStart.isValid())
+            continue;
+
+        QHash<const KCalCore::Incidence *, quint32>::ConstIterator eventIndex = eventIndexes.find(event.data());
+        if (eventIndex == eventIndexes.end()) {
+            QString notebookUid = calendar->notebook(event);
+            QHash<QString, quint32>::ConstIterator notebookIndex = notebookIndexes.find(notebookUid);
+            if (notebookIndex == notebookIndexes.end()) {
+                NotebookRecord notebook;
+                notebook.uid = addString(strings, stringOffsets, notebookUid);
+                notebook.color = addString(strings, stringOffsets, notebookColors.value(notebookUid));
+                notebookIndex = notebookIndexes.insert(notebookUid, notebooks.count());
+                notebooks.append(notebook);
+            }
+
+            QDateTime dtStart = NemoCalendarLocalZone::toLocal(event->dtStart());
+            QDateTime dtEnd = NemoCalendarLocalZone::toLocal(event->dtEnd());
+
+            EventRecord record;
+            memset(&record, 0, sizeof(record));
+            record.start = dtStart.toMSecsSinceEpoch();
+            record.end = dtEnd.isValid() ? dtEnd.toMSecsSinceEpoch() : record.start;
+            record.uid = addString(strings, stringOffsets, event->uid());
+            record.summary = addString(strings, stringOffsets, event->summary());
+            record.location = addString(strings, stringOffsets, event->location());
+            record.notebook = *notebookIndex;
+            record.flags = (event->allDay() ? AllDayFlag : 0) | (dtEnd.isValid() ? 0 : NoEndFlag);
+
+            eventIndex = eventIndexes.insert(event.data(), events.count());
+            events.append(record);
+        }
+
+        Row row;
+        row.start = occurrence.first.dtStart.toMSecsSinceEpoch();
+        row.end = occurrence.first.dtEnd.isValid() ? occurrence.first.dtEnd.toMSecsSinceEpoch() : row.start;
+        row.event = *eventIndex;
+        row.reserved = 0;
+        rows.append(row);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SnapshotMagic;
+    header.version = SnapshotVersion;
+    header.inode = stamp.inode;
+    header.size = stamp.size;
+    header.modified = stamp.modified;
+    header.startDay = start.toJulianDay();
+    header.endDay = end.toJulianDay();
+    header.database = addString(strings, stringOffsets, stamp.database);
+    header.zone = addString(strings, stringOffsets, stamp.zone);
+    header.rowCount = rows.count();
+    header.eventCount = events.count();
+    header.notebookCount = notebooks.count();
+    header.stringBytes = strings.size();
+
+    QByteArray data;
+    data.reserve(sizeof(Header) + rows.count() * sizeof(Row) + events.count() * sizeof(EventRecord) +
+                 notebooks.count() * sizeof(NotebookRecord) + strings.size());
+    data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    appendRecords(data, rows);
+    appendRecords(data, events);
+    appendRecords(data, notebooks);
+    data.append(strings);
+
+    return data;
+}
+
+// The file is written aside and renamed over the old one, so readers in
+// other processes always map a complete snapshot.  Each writer uses its
+// own temporary file, as several processes may write at once.
+bool NemoCalendarSnapshot::write(const Stamp &stamp, const QByteArray &data)
+{
+    if (!stamp.isValid() || data.isEmpty())
+        return false;
+
+    QString name = fileName(stamp);
+    QDir().mkpath(QFileInfo(name).absolutePath());
+
+    QByteArray temporary = QFile::encodeName(name) + ".XXXXXX";
+    int fd = mkstemp(temporary.data());
+    if (fd < 0) {
+        qWarning() << "Cannot create calendar snapshot" << name;
+        return false;
+    }
+
+    qint64 written = 0;
+    while (written < data.size()) {
+        ssize_t rv = ::write(fd, data.constData() + written, data.size() - written);
+        if (rv < 0 && errno == EINTR)
+            continue;
+        if (rv <= 0)
+            break;
+        written += rv;
+    }
+
+    if (::close(fd) != 0 || written != data.size()) {
+        qWarning() << "Cannot write calendar snapshot" << QFile::decodeName(temporary);
+        ::unlink(temporary.constData());
+        return false;
+    }
+
+    if (std::rename(temporary.constData(), QFile::encodeName(name).constData()) != 0) {
+        qWarning() << "Cannot replace calendar snapshot" << name;
+        ::unlink(temporary.constData());
+        return false;
+    }
+
+    return true;
+}
+
+bool NemoCalendarSnapshot::isSharingEnabled()
+{
+    static const bool enabled = isEnabled() && qgetenv("NEMO_CALENDAR_SHARED") == "1";
+    return enabled;
+}
+
+// Shared memory names are system wide, so they include the user
+QByteArray NemoCalendarSnapshot::sharedName(const Stamp &stamp)
+{
+    return "/nemo-calendar-" + QByteArray::number(geteuid()) + "-" + QByteArray::number(qHash(stamp.database), 16);
+}
+
+// Takes the lock making this process the one publishing the occurrence
+// index of the database.  The lock is held until the process exits, after
+// which another process can take over.
+bool NemoCalendarSnapshot::claimPublisher(const Stamp &stamp)
+{
+    static int lockFd = -1;
+    if (lockFd >= 0)
+        return true;
+    if (!stamp.isValid())
+        return false;
+
+    QString name = fileName(stamp) + QLatin1String(".lock");
+    QDir().mkpath(QFileInfo(name).absolutePath());
+
+    int fd = ::open(QFile::encodeName(name).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    lockFd = fd;
+    return true;
+}
+
+// Publishes the layout built for stamp in shared memory.  Processes that
+// mapped the previous segment keep it until they close it, so it is
+// replaced rather than rewritten; the magic is set last, so a segment still
+// being filled is never used.
+bool NemoCalendarSnapshot::publish(const Stamp &stamp, const QByteArray &data)
+{
+    if (!stamp.isValid() || data.size() < int(sizeof(Header)))
+        return false;
+
+    QByteArray name = sharedName(stamp);
+    shm_unlink(name.constData());
+
+    int fd = shm_open(name.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        qWarning() << "Cannot create shared calendar index" << name;
+        return false;
+    }
+
+    // The umask may have narrowed the mode, which readers check
+    void *map = MAP_FAILED;
+    if (fchmod(fd, 0600) == 0 && ftruncate(fd, data.size()) == 0)
+        map = mmap(0, data.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        qWarning() << "Cannot map shared calendar index" << name;
+        shm_unlink(name.constData());
+        return false;
+    }
+
+    char *target = static_cast<char *>(map);
+    memcpy(target + sizeof(quint32), data.constData() + sizeof(quint32), data.size() - sizeof(quint32));
+    __sync_synchronize();
+    memcpy(target, data.constData(), sizeof(quint32));
+
+    munmap(map, data.size());
+    return true;
+}
+
+// Removes the index published for stamp, when the publishing process exits
+void NemoCalendarSnapshot::unpublish(const Stamp &stamp)
+{
+    if (stamp.isValid())
+        shm_unlink(sharedName(stamp).constData());
+}
+
+// The placeholder for the event with the given uid, if it has occurrences
+// in the snapshot
+KCalCore::Event::Ptr NemoCalendarSnapshot::event(const QString &uid)
+{
+    if (!mHeader)
+        return KCalCore::Event::Ptr();
+
+    if (mPlaceholderIndexes.isEmpty()) {
+        for (quint32 ii = 0; ii < mHeader->eventCount; ++ii)
+            mPlaceholderIndexes.insert(string(mEvents[ii].uid), ii);
+    }
+
+    QHash<QString, quint32>::ConstIterator iter = mPlaceholderIndexes.find(uid);
+    return iter == mPlaceholderIndexes.end() ? KCalCore::Event::Ptr() : placeholder(*iter);
+}
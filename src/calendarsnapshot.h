@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+#ifndef CALENDARSNAPSHOT_H
+#define CALENDARSNAPSHOT_H
+
+#include <QFile>
+#include <QHash>
+#include <QDate>
+#include <QVector>
+#include <QStringList>
+
+// mkcal
+#include <event.h>
+#include <extendedcalendar.h>
+
+// A memory mapped file holding the occurrences expanded for a window of
+// days around the date it was written, so that agenda models can be filled
+// at startup before the storage has been loaded.  The file is only used
+// while the database it was written from is unchanged, as identified by the
+// database file's inode, size and modification time and the local time zone.
+//
+// Occurrences are served with placeholder events carrying the uid, summary,
+// location, times and notebook of the real ones; the event cache rebinds
+// their wrappers by uid once the storage is loaded.
+//
+// The same layout can be published in POSIX shared memory, so that plugin
+// instances in other processes map one copy of the occurrences rather than
+// each loading the storage.  A process still loads the storage once it needs
+// more than the placeholders carry, such as event details or alarms.  One
+// process at a time publishes, arbitrated by a lock file next to the
+// snapshot.
+//
+// Setting NEMO_CALENDAR_SNAPSHOT=0 disables snapshots, and setting
+// NEMO_CALENDAR_SHARED=1 enables sharing.
+class NemoCalendarSnapshot
+{
+public:
+    struct Stamp {
+        Stamp();
+
+        QString database;
+        QString zone;
+        qint64 inode;
+        qint64 size;
+        qint64 modified;    // nanoseconds since the epoch
+
+        bool isValid() const;
+        bool operator==(const Stamp &other) const;
+        bool operator!=(const Stamp &other) const { return !operator==(other); }
+    };
+
+    NemoCalendarSnapshot();
+    ~NemoCalendarSnapshot();
+
+    static bool isEnabled();
+    static bool isSharingEnabled();
+
+    // The stamp of the database currently used by the storage
+    static Stamp currentStamp();
+
+    bool open(const Stamp &stamp);
+    bool openShared(const Stamp &stamp);
+    void close();
+    bool isOpen() const { return mHeader != 0; }
+    bool isShared() const { return mShared; }
+
+    QDate startDate() const;
+    QDate endDate() const;
+    bool covers(const QDate &start, const QDate &end) const;
+
+    QStringList notebooks() const;
+    QHash<QString, QString> notebookColors() const;
+
+    // The occurrences overlapping the days from start to end
+    mKCal::ExtendedCalendar::ExpandedIncidenceList occurrences(const QDate &start, const QDate &end);
+    // The notebook of a placeholder event returned by occurrences()
+    QString notebook(const KCalCore::Incidence::Ptr &incidence) const;
+    KCalCore::Event::Ptr event(const QString &uid);
+
+    static QByteArray build(const Stamp &stamp, const QDate &start, const QDate &end,
+                            const mKCal::ExtendedCalendar::ExpandedIncidenceList &occurrences,
+                            const mKCal::ExtendedCalendar::Ptr &calendar,
+                            const QHash<QString, QString> &notebookColors);
+    static bool write(const Stamp &stamp, const QByteArray &data);
+
+    static bool claimPublisher(const Stamp &stamp);
+    static bool publish(const Stamp &stamp, const QByteArray &data);
+    static void unpublish(const Stamp &stamp);
+
+private:
+    struct Header;
+    struct Row;
+    struct EventRecord;
+    struct NotebookRecord;
+
+    static QString fileName(const Stamp &stamp);
+    static QByteArray sharedName(const Stamp &stamp);
+
+    bool attach(const uchar *data, qint64 size, bool shared, const Stamp &stamp);
+
+    QString string(quint32 offset) const;
+    KCalCore::Event::Ptr placeholder(quint32 index);
+
+    QFile mFile;
+    const uchar *mData;
+    qint64 mDataSize;
+    bool mShared;
+    const Header *mHeader;
+    const Row *mRows;
+    const EventRecord *mEvents;
+    const NotebookRecord *mNotebooks;
+    const uchar *mStrings;
+
+    QVector<KCalCore::Event::Ptr> mPlaceholders;
+    QHash<const KCalCore::Incidence *, quint32> mPlaceholderNotebooks;
+    QHash<QString, quint32> mPlaceholderIndexes;
+};
+
+#endif // CALENDARSNAPSHOT_H
@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarstats.h"
+
+#include <QFile>
+#include <QEvent>
+#include <QCoreApplication>
+
+#include "calendardb.h"
+#include "calendarevent.h"
+#include "calendareventcache.h"
+
+// Trace events beyond this are dropped; the stage totals keep counting
+static const int MaximumTraceEvents = 100000;
+
+// Rough sizes for the memory estimates.  Objects carry their QObject
+// private data, QDateTimes their shared data, and incidences a private
+// part, strings and lists beyond what sizeof() sees.
+static const int ObjectOverhead = 120;
+static const int DateTimeOverhead = 48;
+static const int IncidenceOverhead = 400;
+static const int AlarmSize = 150;
+static const int RecurrenceSize = 200;
+static const int RecurrenceRuleSize = 300;
+
+static const qint64 OccurrenceSize = sizeof(NemoCalendarEventOccurrence) + ObjectOverhead + 2 * DateTimeOverhead;
+static const qint64 EventSize = sizeof(NemoCalendarEvent) + ObjectOverhead;
+
+static qint64 estimateSize(const KCalCore::Event::Ptr &event)
+{
+    qint64 size = sizeof(KCalCore::Event) + IncidenceOverhead;
+    size += 2 * (event->uid().size() + event->summary().size() + event->description().size() +
+                 event->location().size());
+    size += event->alarms().count() * AlarmSize;
+
+    if (event->recurs()) {
+        KCalCore::Recurrence *recurrence = event->recurrence();
+        size += RecurrenceSize + recurrence->rRules().count() * RecurrenceRuleSize;
+        size += (recurrence->exDateTimes().count() + recurrence->rDateTimes().count()) * sizeof(KDateTime);
+        size += (recurrence->exDates().count() + recurrence->rDates().count()) * sizeof(QDate);
+    }
+
+    return size;
+}
+
+static const char *stageNames[NemoCalendarStats::StageCount] = {
+    "load",
+    "expand",
+    "refresh",
+    "save"
+};
+
+static const char *counterNames[NemoCalendarStats::CounterCount] = {
+    "rowsInserted",
+    "rowsRemoved",
+    "occurrencesExpanded",
+    "wrappersRebound",
+    "savesIssued"
+};
+
+static bool traceEnabled()
+{
+    QByteArray trace = qgetenv("NEMO_CALENDAR_TRACE");
+    return !trace.isEmpty() && trace != "0";
+}
+
+bool NemoCalendarStats::mEnabled = traceEnabled();
+
+static void dumpTraceAtExit()
+{
+    QString fileName = QString::fromLocal8Bit(qgetenv("NEMO_CALENDAR_TRACE"));
+    if (!NemoCalendarStats::instance()->dumpTrace(fileName))
+        qWarning("NEMO_CALENDAR_TRACE: cannot write %s", qPrintable(fileName));
+}
+
+NemoCalendarStats::NemoCalendarStats()
+: QObject(0), mChangedEventSent(false), mObjectsRead(false), mIncidencesScanned(false),
+  mIncidenceCount(0), mIncidenceBytes(0)
+{
+    mClock.start();
+    for (int ii = 0; ii < CounterCount; ++ii)
+        mCounters[ii] = 0;
+
+    if (mEnabled && qgetenv("NEMO_CALENDAR_TRACE") != "1")
+        qAddPostRoutine(dumpTraceAtExit);
+}
+
+NemoCalendarStats *NemoCalendarStats::instance()
+{
+    static NemoCalendarStats *statsInstance;
+    if (!statsInstance)
+        statsInstance = new NemoCalendarStats;
+
+    return statsInstance;
+}
+
+bool NemoCalendarStats::enabled() const
+{
+    return mEnabled;
+}
+
+QVariantMap NemoCalendarStats::counters() const
+{
+    QVariantMap rv;
+    for (int ii = 0; ii < CounterCount; ++ii)
+        rv.insert(counterNames[ii], mCounters[ii]);
+    return rv;
+}
+
+// Returns, for each stage, the number of times it ran and the total and
+// longest duration in milliseconds
+QVariantMap NemoCalendarStats::stages() const
+{
+    QVariantMap rv;
+    for (int ii = 0; ii < StageCount; ++ii) {
+        QVariantMap stage;
+        stage.insert("count", mStages[ii].count);
+        stage.insert("total", mStages[ii].total / 1000.);
+        stage.insert("max", mStages[ii].max / 1000.);
+        rv.insert(stageNames[ii], stage);
+    }
+    return rv;
+}
+
+int NemoCalendarStats::liveEvents() const
+{
+    mObjectsRead = true;
+    return NemoCalendarEventCache::instance()->mEvents.count();
+}
+
+int NemoCalendarStats::liveOccurrences() const
+{
+    mObjectsRead = true;
+    return NemoCalendarEventCache::instance()->mEventOccurrences.count();
+}
+
+// Occurrence wrappers not owned by any model or query, which are leaked
+// unless something else deletes them
+int NemoCalendarStats::orphanedOccurrences() const
+{
+    mObjectsRead = true;
+    const QSet<NemoCalendarEventOccurrence *> &occurrences = NemoCalendarEventCache::instance()->mEventOccurrences;
+
+    int rv = 0;
+    for (QSet<NemoCalendarEventOccurrence *>::ConstIterator iter = occurrences.begin(); iter != occurrences.end(); ++iter) {
+        if (!(*iter)->parent())
+            ++rv;
+    }
+    return rv;
+}
+
+// Returns, for each model or query holding wrappers, its type, object name,
+// the number of occurrence and event wrappers it holds and an estimate of
+// their size in bytes
+QVariantList NemoCalendarStats::models() const
+{
+    mObjectsRead = true;
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    QHash<QObject *, QPair<int, int> > owners;
+
+    for (QSet<NemoCalendarEventOccurrence *>::ConstIterator iter = cache->mEventOccurrences.begin();
+         iter != cache->mEventOccurrences.end(); ++iter) {
+        if (QObject *owner = (*iter)->parent())
+            ++owners[owner].first;
+    }
+
+    // Event wrappers belong to the owner of their occurrence, if any
+    for (QSet<NemoCalendarEvent *>::ConstIterator iter = cache->mEvents.begin(); iter != cache->mEvents.end(); ++iter) {
+        QObject *owner = (*iter)->parent();
+        if (qobject_cast<NemoCalendarEventOccurrence *>(owner))
+            owner = owner->parent();
+        if (owner)
+            ++owners[owner].second;
+    }
+
+    QVariantList rv;
+    for (QHash<QObject *, QPair<int, int> >::ConstIterator iter = owners.begin(); iter != owners.end(); ++iter) {
+        QVariantMap model;
+        model.insert("type", QString::fromLatin1(iter.key()->metaObject()->className()));
+        model.insert("name", iter.key()->objectName());
+        model.insert("occurrences", iter->first);
+        model.insert("events", iter->second);
+        model.insert("estimatedBytes", double(iter->first * OccurrenceSize + iter->second * EventSize));
+        rv.append(model);
+    }
+    return rv;
+}
+
+int NemoCalendarStats::loadedIncidences() const
+{
+    scanIncidences();
+    return mIncidenceCount;
+}
+
+// An estimate of the memory held by the loaded incidences
+double NemoCalendarStats::incidenceBytes() const
+{
+    scanIncidences();
+    return mIncidenceBytes;
+}
+
+QVariantMap NemoCalendarStats::notebookIncidences() const
+{
+    scanIncidences();
+
+    QVariantMap rv;
+    for (QHash<QString, int>::ConstIterator iter = mNotebookIncidences.begin(); iter != mNotebookIncidences.end(); ++iter)
+        rv.insert(iter.key(), iter.value());
+    return rv;
+}
+
+// Works out all the incidence figures in one pass over the loaded
+// incidences, which is kept until they change
+void NemoCalendarStats::scanIncidences() const
+{
+    mObjectsRead = true;
+    if (mIncidencesScanned)
+        return;
+
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    KCalCore::Event::List events = calendar->rawEvents();
+
+    mIncidenceCount = events.count();
+    mIncidenceBytes = 0;
+    mNotebookIncidences.clear();
+    for (int ii = 0; ii < events.count(); ++ii) {
+        mIncidenceBytes += estimateSize(events.at(ii));
+        ++mNotebookIncidences[calendar->notebook(events.at(ii))];
+    }
+
+    mIncidencesScanned = true;
+}
+
+void NemoCalendarStats::objectsChanged()
+{
+    mIncidencesScanned = false;
+
+    if (mEnabled && mSamples.count() < MaximumTraceEvents) {
+        ObjectSample sample;
+        sample.time = mClock.nsecsElapsed() / 1000;
+        sample.events = liveEvents();
+        sample.occurrences = liveOccurrences();
+        sample.orphanedOccurrences = orphanedOccurrences();
+        sample.incidences = NemoCalendarDb::calendar()->rawEvents().count();
+        mSamples.append(sample);
+    }
+
+    if (mEnabled || mObjectsRead)
+        scheduleChanged();
+}
+
+void NemoCalendarStats::reset()
+{
+    for (int ii = 0; ii < CounterCount; ++ii)
+        mCounters[ii] = 0;
+    for (int ii = 0; ii < StageCount; ++ii)
+        mStages[ii] = StageStats();
+    mTrace.clear();
+    mSamples.clear();
+
+    emit changed();
+}
+
+// Writes the recorded stages as complete ("X") events and the counters as a
+// final counter ("C") event, in the format read by chrome://tracing
+bool NemoCalendarStats::dumpTrace(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    qint64 pid = QCoreApplication::applicationPid();
+
+    QByteArray data;
+    data.append("{\"traceEvents\":[\n");
+    for (int ii = 0; ii < mTrace.count(); ++ii) {
+        const TraceEvent &event = mTrace.at(ii);
+        data.append("{\"name\":\"");
+        data.append(stageNames[event.stage]);
+        data.append("\",\"cat\":\"calendar\",\"ph\":\"X\",\"pid\":");
+        data.append(QByteArray::number(pid));
+        data.append(",\"tid\":1,\"ts\":");
+        data.append(QByteArray::number(event.start));
+        data.append(",\"dur\":");
+        data.append(QByteArray::number(event.duration));
+        data.append("},\n");
+
+        if (data.size() > 64 * 1024) {
+            file.write(data);
+            data.clear();
+        }
+    }
+
+    // Live objects as counter tracks
+    for (int ii = 0; ii < mSamples.count(); ++ii) {
+        const ObjectSample &sample = mSamples.at(ii);
+        data.append("{\"name\":\"objects\",\"cat\":\"calendar\",\"ph\":\"C\",\"pid\":");
+        data.append(QByteArray::number(pid));
+        data.append(",\"tid\":1,\"ts\":");
+        data.append(QByteArray::number(sample.time));
+        data.append(",\"args\":{\"events\":");
+        data.append(QByteArray::number(sample.events));
+        data.append(",\"occurrences\":");
+        data.append(QByteArray::number(sample.occurrences));
+        data.append(",\"orphanedOccurrences\":");
+        data.append(QByteArray::number(sample.orphanedOccurrences));
+        data.append(",\"incidences\":");
+        data.append(QByteArray::number(sample.incidences));
+        data.append("}},\n");
+    }
+
+    data.append("{\"name\":\"counters\",\"cat\":\"calendar\",\"ph\":\"C\",\"pid\":");
+    data.append(QByteArray::number(pid));
+    data.append(",\"tid\":1,\"ts\":");
+    data.append(QByteArray::number(mClock.nsecsElapsed() / 1000));
+    data.append(",\"args\":{");
+    for (int ii = 0; ii < CounterCount; ++ii) {
+        if (ii)
+            data.append(',');
+        data.append('"');
+        data.append(counterNames[ii]);
+        data.append("\":");
+        data.append(QByteArray::number(mCounters[ii]));
+    }
+    data.append("}}\n]}\n");
+
+    return file.write(data) == data.size();
+}
+
+bool NemoCalendarStats::event(QEvent *e)
+{
+    if (e->type() == QEvent::User) {
+        mChangedEventSent = false;
+        mObjectsRead = false;
+        emit changed();
+        return true;
+    }
+    return QObject::event(e);
+}
+
+void NemoCalendarStats::addCount(Counter counter, int n)
+{
+    mCounters[counter] += n;
+    scheduleChanged();
+}
+
+void NemoCalendarStats::addStage(Stage stage, qint64 start, qint64 duration)
+{
+    StageStats &stats = mStages[stage];
+    ++stats.count;
+    stats.total += duration;
+    stats.max = qMax(stats.max, duration);
+
+    if (mTrace.count() < MaximumTraceEvents) {
+        TraceEvent event;
+        event.stage = stage;
+        event.start = start;
+        event.duration = duration;
+        mTrace.append(event);
+    }
+
+    scheduleChanged();
+}
+
+// Coalesces notifications so bindings to the stats are not reevaluated
+// inside the stages being measured
+void NemoCalendarStats::scheduleChanged()
+{
+    if (!mChangedEventSent) {
+        mChangedEventSent = true;
+        QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+    }
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARSTATS_H
+#define CALENDARSTATS_H
+
+#include <QHash>
+#include <QObject>
+#include <QVector>
+#include <QVariantMap>
+#include <QVariantList>
+#include <QElapsedTimer>
+
+// Durations and counters for the expensive stages of the plugin.  Nothing
+// is recorded unless NEMO_CALENDAR_TRACE is set in the environment; if its
+// value is a file name rather than "1", a Chrome trace-event JSON file is
+// also written there when the application exits.
+//
+// The live object and memory figures are always available.  They are
+// computed when read, the incidence figures at most once per cache load,
+// and sampled into the trace after each cache load and agenda refresh
+// while tracing.  changed() only follows those updates while tracing or
+// once the figures have been read.
+//
+// Only to be used from the GUI thread.
+class NemoCalendarStats : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool enabled READ enabled CONSTANT)
+    Q_PROPERTY(QVariantMap counters READ counters NOTIFY changed)
+    Q_PROPERTY(QVariantMap stages READ stages NOTIFY changed)
+    Q_PROPERTY(int liveEvents READ liveEvents NOTIFY changed)
+    Q_PROPERTY(int liveOccurrences READ liveOccurrences NOTIFY changed)
+    Q_PROPERTY(int orphanedOccurrences READ orphanedOccurrences NOTIFY changed)
+    Q_PROPERTY(QVariantList models READ models NOTIFY changed)
+    Q_PROPERTY(int loadedIncidences READ loadedIncidences NOTIFY changed)
+    Q_PROPERTY(double incidenceBytes READ incidenceBytes NOTIFY changed)
+    Q_PROPERTY(QVariantMap notebookIncidences READ notebookIncidences NOTIFY changed)
+
+public:
+    enum Stage {
+        LoadStage,
+        ExpandStage,
+        RefreshStage,
+        SaveStage,
+        StageCount
+    };
+
+    enum Counter {
+        RowsInserted,
+        RowsRemoved,
+        OccurrencesExpanded,
+        WrappersRebound,
+        SavesIssued,
+        CounterCount
+    };
+
+    static NemoCalendarStats *instance();
+
+    static inline bool isEnabled();
+    static inline void count(Counter, int n = 1);
+
+    bool enabled() const;
+    QVariantMap counters() const;
+    QVariantMap stages() const;
+
+    int liveEvents() const;
+    int liveOccurrences() const;
+    int orphanedOccurrences() const;
+    QVariantList models() const;
+    int loadedIncidences() const;
+    double incidenceBytes() const;
+    QVariantMap notebookIncidences() const;
+
+    // Called when the set of live objects may have changed
+    void objectsChanged();
+
+    Q_INVOKABLE void reset();
+    Q_INVOKABLE bool dumpTrace(const QString &fileName) const;
+
+signals:
+    void changed();
+
+protected:
+    virtual bool event(QEvent *);
+
+private:
+    friend class NemoCalendarTrace;
+
+    struct StageStats {
+        StageStats() : count(0), total(0), max(0) {}
+
+        int count;
+        qint64 total;       // microseconds
+        qint64 max;
+    };
+
+    struct TraceEvent {
+        Stage stage;
+        qint64 start;       // microseconds since the clock started
+        qint64 duration;
+    };
+
+    struct ObjectSample {
+        qint64 time;        // microseconds since the clock started
+        int events;
+        int occurrences;
+        int orphanedOccurrences;
+        int incidences;
+    };
+
+    NemoCalendarStats();
+
+    void addCount(Counter, int n);
+    void addStage(Stage, qint64 start, qint64 duration);
+    void scheduleChanged();
+    void scanIncidences() const;
+
+    static bool mEnabled;
+
+    QElapsedTimer mClock;
+    int mCounters[CounterCount];
+    StageStats mStages[StageCount];
+    QVector<TraceEvent> mTrace;
+    QVector<ObjectSample> mSamples;
+    bool mChangedEventSent;
+
+    // Set when the object figures are read, so that changes to them are
+    // only notified to something that shows them
+    mutable bool mObjectsRead;
+
+    // Scan of the loaded incidences, dropped by objectsChanged()
+    mutable bool mIncidencesScanned;
+    mutable int mIncidenceCount;
+    mutable qint64 mIncidenceBytes;
+    mutable QHash<QString, int> mNotebookIncidences;
+};
+
+// Records the time spent in a stage from construction to destruction
+class NemoCalendarTrace
+{
+public:
+    inline NemoCalendarTrace(NemoCalendarStats::Stage);
+    inline ~NemoCalendarTrace();
+
+private:
+    NemoCalendarStats::Stage mStage;
+    qint64 mStart;
+};
+
+bool NemoCalendarStats::isEnabled()
+{
+    return mEnabled;
+}
+
+void NemoCalendarStats::count(Counter counter, int n)
+{
+    if (mEnabled)
+        instance()->addCount(counter, n);
+}
+
+NemoCalendarTrace::NemoCalendarTrace(NemoCalendarStats::Stage stage)
+: mStage(stage), mStart(-1)
+{
+    if (NemoCalendarStats::isEnabled())
+        mStart = NemoCalendarStats::instance()->mClock.nsecsElapsed() / 1000;
+}
+
+NemoCalendarTrace::~NemoCalendarTrace()
+{
+    if (mStart >= 0) {
+        NemoCalendarStats *stats = NemoCalendarStats::instance();
+        stats->addStage(mStage, mStart, stats->mClock.nsecsElapsed() / 1000 - mStart);
+    }
+}
+
+#endif // CALENDARSTATS_H
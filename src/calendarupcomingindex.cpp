@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarupcomingindex.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+// kdepimlibs
+#include <ksystemtimezone.h>
+
+#include "calendarlocalzone.h"
+
+NemoCalendarUpcomingIndex::NemoCalendarUpcomingIndex()
+: mNextGeneration(0), mStaleEntries(0), mRevision(0)
+{
+}
+
+// Brings the index up to date with the events currently loaded in
+// calendar.  Only events whose revision or modification time changed have
+// their pending occurrence recomputed, unless the local time zone changed.
+void NemoCalendarUpcomingIndex::sync(const mKCal::ExtendedCalendar::Ptr &calendar)
+{
+    if (!mFrom.isValid() || KSystemTimeZones::local().name() != mZone)
+        reset(KDateTime::currentUtcDateTime());
+
+    KCalCore::Event::List events = calendar->rawEvents();
+    QSet<QString> seen;
+
+    for (int ii = 0; ii < events.count(); ++ii) {
+        const KCalCore::Event::Ptr &event = events.at(ii);
+        QString key = instanceKey(event);
+        seen.insert(key);
+
+        QHash<QString, Stamp>::ConstIterator stamp = mStamps.find(key);
+        if (stamp != mStamps.end() && stamp->event == event && stamp->revision == event->revision() &&
+            stamp->lastModified == event->lastModified())
+            continue;
+
+        update(event);
+    }
+
+    QStringList removed;
+    for (QHash<QString, Stamp>::ConstIterator iter = mStamps.begin(); iter != mStamps.end(); ++iter) {
+        if (!seen.contains(iter.key()))
+            removed.append(iter.key());
+    }
+
+    for (int ii = 0; ii < removed.count(); ++ii)
+        remove(removed.at(ii));
+}
+
+void NemoCalendarUpcomingIndex::update(const KCalCore::Incidence::Ptr &incidence)
+{
+    KCalCore::Event::Ptr event = incidence.dynamicCast<KCalCore::Event>();
+    if (!event || !mFrom.isValid())
+        return;
+
+    QString key = instanceKey(event);
+    invalidate(key);
+    ++mRevision;
+
+    if (event->hasRecurrenceId()) {
+        QList<KDateTime> &overridden = mOverridden[event->uid()];
+        if (!overridden.contains(event->recurrenceId()))
+            overridden.append(event->recurrenceId());
+    }
+
+    Stamp stamp;
+    stamp.event = event;
+    stamp.revision = event->revision();
+    stamp.lastModified = event->lastModified();
+    stamp.generation = mNextGeneration++;
+    stamp.pending = false;
+
+    Entry entry;
+    entry.event = event;
+    entry.key = key;
+    entry.generation = stamp.generation;
+    if (first(entry, mFrom)) {
+        push(mHeap, entry);
+        stamp.pending = true;
+    }
+
+    mStamps.insert(key, stamp);
+}
+
+void NemoCalendarUpcomingIndex::remove(const QString &key)
+{
+    invalidate(key);
+
+    QHash<QString, Stamp>::Iterator stamp = mStamps.find(key);
+    if (stamp == mStamps.end())
+        return;
+
+    KCalCore::Event::Ptr event = stamp->event;
+    mStamps.erase(stamp);
+    ++mRevision;
+
+    if (event && event->hasRecurrenceId()) {
+        QHash<QString, QList<KDateTime> >::Iterator overridden = mOverridden.find(event->uid());
+        if (overridden != mOverridden.end()) {
+            overridden->removeOne(event->recurrenceId());
+            if (overridden->isEmpty())
+                mOverridden.erase(overridden);
+        }
+    }
+}
+
+// Returns the first limit occurrences, in start order, of events in the
+// given notebooks that have not ended by from.  The index is advanced to
+// from, so following the current time costs only the occurrences that
+// ended since the last query and the ones merged into the result.  Times
+// before the last query are answered from every event, leaving the index
+// as it is.
+mKCal::ExtendedCalendar::ExpandedIncidenceList NemoCalendarUpcomingIndex::upcoming(const KDateTime &from, int limit,
+                                                                                  const mKCal::ExtendedCalendar::Ptr &calendar,
+                                                                                  const QSet<QString> &notebooks)
+{
+    mKCal::ExtendedCalendar::ExpandedIncidenceList rv;
+    if (limit <= 0 || !mFrom.isValid())
+        return rv;
+
+    if (KSystemTimeZones::local().name() != mZone)
+        reset(from);
+
+    if (from.toUtc().dateTime() >= mFrom.toUtc().dateTime()) {
+        advance(from);
+        merge(mHeap, limit, calendar, notebooks, &rv);
+        return rv;
+    }
+
+    QVector<Entry> heap;
+    heap.reserve(mStamps.count());
+    for (QHash<QString, Stamp>::ConstIterator iter = mStamps.begin(); iter != mStamps.end(); ++iter) {
+        Entry entry;
+        entry.event = iter->event;
+        entry.key = iter.key();
+        entry.generation = iter->generation;
+        if (first(entry, from))
+            heap.append(entry);
+    }
+    std::make_heap(heap.begin(), heap.end(), entryGreaterThan);
+
+    merge(heap, limit, calendar, notebooks, &rv);
+    return rv;
+}
+
+void NemoCalendarUpcomingIndex::calendarIncidenceAdded(const KCalCore::Incidence::Ptr &incidence)
+{
+    update(incidence);
+}
+
+void NemoCalendarUpcomingIndex::calendarIncidenceChanged(const KCalCore::Incidence::Ptr &incidence)
+{
+    update(incidence);
+}
+
+void NemoCalendarUpcomingIndex::calendarIncidenceDeleted(const KCalCore::Incidence::Ptr &incidence)
+{
+    if (incidence)
+        remove(instanceKey(incidence));
+}
+
+// std heaps keep the greatest element on top, so order by descending start
+bool NemoCalendarUpcomingIndex::entryGreaterThan(const Entry &e1, const Entry &e2)
+{
+    if (e1.utcStart != e2.utcStart)
+        return e2.utcStart < e1.utcStart;
+    return e2.event->uid() < e1.event->uid();
+}
+
+QString NemoCalendarUpcomingIndex::instanceKey(const KCalCore::Incidence::Ptr &incidence)
+{
+    if (incidence->hasRecurrenceId())
+        return incidence->uid() + QLatin1Char('/') + incidence->recurrenceId().toString();
+    return incidence->uid();
+}
+
+void NemoCalendarUpcomingIndex::push(QVector<Entry> &heap, const Entry &entry)
+{
+    heap.append(entry);
+    std::push_heap(heap.begin(), heap.end(), entryGreaterThan);
+}
+
+NemoCalendarUpcomingIndex::Entry NemoCalendarUpcomingIndex::pop(QVector<Entry> &heap)
+{
+    std::pop_heap(heap.begin(), heap.end(), entryGreaterThan);
+    Entry entry = heap.last();
+    heap.removeLast();
+    return entry;
+}
+
+bool NemoCalendarUpcomingIndex::isCurrent(const Entry &entry) const
+{
+    QHash<QString, Stamp>::ConstIterator stamp = mStamps.find(entry.key);
+    return stamp != mStamps.end() && stamp->generation == entry.generation;
+}
+
+bool NemoCalendarUpcomingIndex::isOverridden(const Entry &entry) const
+{
+    if (!entry.event->recurs())
+        return false;
+
+    QHash<QString, QList<KDateTime> >::ConstIterator overridden = mOverridden.find(entry.event->uid());
+    return overridden != mOverridden.end() && overridden->contains(entry.start);
+}
+
+// Returns the end of the occurrence of event starting at start.  All day
+// events end at the end of their last day.
+static KDateTime occurrenceEnd(const KCalCore::Event::Ptr &event, const KDateTime &start)
+{
+    KDateTime end = KCalCore::Duration(event->dtStart(), event->dtEnd()).end(start);
+    if (event->allDay())
+        end = KDateTime(end.date().addDays(1), QTime(0, 0), KDateTime::Spec(KDateTime::LocalZone));
+    return end;
+}
+
+// Moves entry to the first occurrence of its event that has not ended by
+// from.  Returns false if there is none.
+bool NemoCalendarUpcomingIndex::first(Entry &entry, const KDateTime &from)
+{
+    const KCalCore::Event::Ptr &event = entry.event;
+    KDateTime start;
+
+    if (event->recurs()) {
+        KCalCore::Recurrence *recurrence = event->recurrence();
+        KDateTime previous = recurrence->getPreviousDateTime(from);
+        if (recurrence->recursAt(from))
+            start = from;
+        else if (!previous.isNull() && occurrenceEnd(event, previous) > from)
+            start = previous;
+        else
+            start = recurrence->getNextDateTime(from);
+    } else if (occurrenceEnd(event, event->dtStart()) > from) {
+        start = event->dtStart();
+    }
+
+    if (start.isNull())
+        return false;
+
+    setStart(entry, start);
+    return true;
+}
+
+// Moves entry to the following occurrence of its event.  Returns false if
+// there is none.
+bool NemoCalendarUpcomingIndex::next(Entry &entry)
+{
+    if (!entry.event->recurs())
+        return false;
+
+    KDateTime start = entry.event->recurrence()->getNextDateTime(entry.start);
+    if (start.isNull())
+        return false;
+
+    setStart(entry, start);
+    return true;
+}
+
+void NemoCalendarUpcomingIndex::setStart(Entry &entry, const KDateTime &start)
+{
+    entry.start = start;
+    entry.utcStart = start.toUtc().dateTime();
+    entry.utcEnd = occurrenceEnd(entry.event, start).toUtc().dateTime();
+}
+
+// Moves the entries whose occurrence has ended by from to the next pending
+// occurrence.  Only entries starting by from can have ended, and those are
+// at the top of the heap.
+void NemoCalendarUpcomingIndex::advance(const KDateTime &from)
+{
+    QDateTime utcFrom = from.toUtc().dateTime();
+    QVector<Entry> pending;
+
+    while (!mHeap.isEmpty() && mHeap.first().utcStart <= utcFrom) {
+        Entry entry = pop(mHeap);
+        if (!isCurrent(entry)) {
+            --mStaleEntries;
+            continue;
+        }
+
+        if (entry.utcEnd > utcFrom || first(entry, from))
+            pending.append(entry);
+        else
+            mStamps[entry.key].pending = false;
+    }
+
+    for (int ii = 0; ii < pending.count(); ++ii)
+        push(mHeap, pending.at(ii));
+
+    mFrom = from;
+}
+
+// Merges the occurrences of the entries in source, taking entries off the
+// source heap only while they could start before the occurrences already
+// being merged.  The entries taken are put back afterwards.
+void NemoCalendarUpcomingIndex::merge(QVector<Entry> &source, int limit, const mKCal::ExtendedCalendar::Ptr &calendar,
+                                      const QSet<QString> &notebooks,
+                                      mKCal::ExtendedCalendar::ExpandedIncidenceList *occurrences)
+{
+    QVector<Entry> taken;
+    QVector<Entry> heap;
+
+    while (occurrences->count() < limit) {
+        while (!source.isEmpty() && (heap.isEmpty() || !entryGreaterThan(source.first(), heap.first()))) {
+            Entry entry = pop(source);
+            if (!isCurrent(entry)) {
+                // Stale entries are only dropped from the index itself
+                if (&source == &mHeap)
+                    --mStaleEntries;
+                continue;
+            }
+
+            taken.append(entry);
+            if (notebooks.contains(calendar->notebook(entry.event)))
+                push(heap, entry);
+        }
+
+        if (heap.isEmpty())
+            break;
+
+        std::pop_heap(heap.begin(), heap.end(), entryGreaterThan);
+        Entry &entry = heap.last();
+
+        if (!isOverridden(entry)) {
+            mKCal::ExtendedCalendar::ExpandedIncidenceValidity eiv = {
+                NemoCalendarLocalZone::toLocal(entry.start),
+                NemoCalendarLocalZone::toLocal(KCalCore::Duration(entry.event->dtStart(), entry.event->dtEnd()).end(entry.start))
+            };
+            occurrences->append(qMakePair(eiv, entry.event.dynamicCast<KCalCore::Incidence>()));
+        }
+
+        if (next(entry))
+            std::push_heap(heap.begin(), heap.end(), entryGreaterThan);
+        else
+            heap.removeLast();
+    }
+
+    for (int ii = 0; ii < taken.count(); ++ii)
+        push(source, taken.at(ii));
+}
+
+// Marks the entry of key as stale, compacting the heap once more than half
+// of it is stale
+void NemoCalendarUpcomingIndex::invalidate(const QString &key)
+{
+    QHash<QString, Stamp>::Iterator stamp = mStamps.find(key);
+    if (stamp == mStamps.end())
+        return;
+
+    if (stamp->pending)
+        ++mStaleEntries;
+    stamp->generation = -1;
+    stamp->pending = false;
+
+    if (mStaleEntries * 2 <= mHeap.count())
+        return;
+
+    QVector<Entry> heap;
+    heap.reserve(mHeap.count() - mStaleEntries);
+    for (int ii = 0; ii < mHeap.count(); ++ii) {
+        if (isCurrent(mHeap.at(ii)))
+            heap.append(mHeap.at(ii));
+    }
+
+    mHeap = heap;
+    std::make_heap(mHeap.begin(), mHeap.end(), entryGreaterThan);
+    mStaleEntries = 0;
+}
+
+// Recomputes every entry for from, as when the local time zone changes
+void NemoCalendarUpcomingIndex::reset(const KDateTime &from)
+{
+    mHeap.clear();
+    mStaleEntries = 0;
+    mFrom = from;
+    mZone = KSystemTimeZones::local().name();
+    ++mRevision;
+
+    for (QHash<QString, Stamp>::Iterator iter = mStamps.begin(); iter != mStamps.end(); ++iter) {
+        Entry entry;
+        entry.event = iter->event;
+        entry.key = iter.key();
+        entry.generation = iter->generation = mNextGeneration++;
+        iter->pending = first(entry, from);
+        if (iter->pending)
+            mHeap.append(entry);
+    }
+
+    std::make_heap(mHeap.begin(), mHeap.end(), entryGreaterThan);
+}
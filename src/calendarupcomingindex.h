@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARUPCOMINGINDEX_H
+#define CALENDARUPCOMINGINDEX_H
+
+#include <QSet>
+#include <QHash>
+#include <QVector>
+#include <QDateTime>
+
+// mkcal
+#include <event.h>
+#include <extendedcalendar.h>
+
+// Keeps the pending occurrence of every event, the first one that has not
+// ended, in a min-heap ordered by start.  The next occurrences across the
+// calendar are then found by merging from the top of the heap, without
+// visiting every event on each query.  Entries are advanced as the time
+// asked about moves forward.
+class NemoCalendarUpcomingIndex : public KCalCore::Calendar::CalendarObserver
+{
+public:
+    NemoCalendarUpcomingIndex();
+
+    void sync(const mKCal::ExtendedCalendar::Ptr &calendar);
+    void update(const KCalCore::Incidence::Ptr &incidence);
+    void remove(const QString &key);
+
+    mKCal::ExtendedCalendar::ExpandedIncidenceList upcoming(const KDateTime &from, int limit,
+                                                            const mKCal::ExtendedCalendar::Ptr &calendar,
+                                                            const QSet<QString> &notebooks);
+
+    // Changes whenever an event is added, changed or removed, so callers
+    // can tell whether an earlier answer still holds
+    int revision() const { return mRevision; }
+
+    /* KCalCore::Calendar::CalendarObserver */
+    void calendarIncidenceAdded(const KCalCore::Incidence::Ptr &incidence);
+    void calendarIncidenceChanged(const KCalCore::Incidence::Ptr &incidence);
+    void calendarIncidenceDeleted(const KCalCore::Incidence::Ptr &incidence);
+
+private:
+    struct Entry {
+        KDateTime start;
+        QDateTime utcStart;
+        QDateTime utcEnd;       // when the occurrence stops being pending
+        KCalCore::Event::Ptr event;
+        QString key;
+        int generation;
+    };
+
+    struct Stamp {
+        KCalCore::Event::Ptr event;
+        int revision;
+        KDateTime lastModified;
+        int generation;
+        bool pending;           // whether the heap holds an entry
+    };
+
+    static bool entryGreaterThan(const Entry &, const Entry &);
+    static QString instanceKey(const KCalCore::Incidence::Ptr &);
+    static void push(QVector<Entry> &heap, const Entry &);
+    static Entry pop(QVector<Entry> &heap);
+
+    bool isCurrent(const Entry &) const;
+    bool isOverridden(const Entry &) const;
+    static bool first(Entry &, const KDateTime &from);
+    static bool next(Entry &);
+    static void setStart(Entry &, const KDateTime &start);
+
+    void advance(const KDateTime &from);
+    void merge(QVector<Entry> &source, int limit, const mKCal::ExtendedCalendar::Ptr &calendar,
+               const QSet<QString> &notebooks, mKCal::ExtendedCalendar::ExpandedIncidenceList *occurrences);
+    void invalidate(const QString &key);
+    void reset(const KDateTime &from);
+
+    // Entries of events that have since changed or gone are left in the
+    // heap and skipped when they reach the top
+    QVector<Entry> mHeap;
+    QHash<QString, Stamp> mStamps;
+    int mNextGeneration;
+    int mStaleEntries;
+    int mRevision;
+
+    // Instances of recurring events replaced by an exception incidence
+    QHash<QString, QList<KDateTime> > mOverridden;
+
+    // The time the entries are pending at, which queries may not precede,
+    // and the local time zone they were computed in
+    KDateTime mFrom;
+    QString mZone;
+};
+
+#endif // CALENDARUPCOMINGINDEX_H
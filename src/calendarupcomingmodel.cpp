@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarupcomingmodel.h"
+
+#include "calendardb.h"
+#include "calendarevent.h"
+#include "calendareventcache.h"
+#include "calendarstats.h"
+
+NemoCalendarUpcomingModel::NemoCalendarUpcomingModel(QObject *parent)
+: QAbstractListModel(parent), mIsComplete(true), mLimit(5), mIndexRevision(-1)
+{
+    mRoleNames[EventObjectRole] = "event";
+    mRoleNames[OccurrenceObjectRole] = "occurrence";
+    mRoleNames[SectionBucketRole] = "sectionBucket";
+    mRoleNames[OngoingRole] = "ongoing";
+
+    connect(&mBoundaryTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    connect(&mBoundaryTimer, SIGNAL(clockChanged()), this, SLOT(refresh()));
+
+    connect(NemoCalendarEventCache::instance(), SIGNAL(modelReset()), this, SLOT(storageChanged()));
+}
+
+NemoCalendarUpcomingModel::~NemoCalendarUpcomingModel()
+{
+    qDeleteAll(mEvents);
+}
+
+QHash<int, QByteArray> NemoCalendarUpcomingModel::roleNames() const
+{
+    return mRoleNames;
+}
+
+// The maximum number of occurrences in the model
+int NemoCalendarUpcomingModel::limit() const
+{
+    return mLimit;
+}
+
+void NemoCalendarUpcomingModel::setLimit(int limit)
+{
+    if (mLimit == limit)
+        return;
+
+    mLimit = limit;
+    emit limitChanged();
+
+    refresh();
+}
+
+// Occurrences that have not ended by startTime are included.  If not set,
+// the model follows the current time, updating itself whenever one of its
+// occurrences starts or ends.
+QDateTime NemoCalendarUpcomingModel::startTime() const
+{
+    return mStartTime;
+}
+
+void NemoCalendarUpcomingModel::setStartTime(const QDateTime &startTime)
+{
+    if (mStartTime == startTime)
+        return;
+
+    mStartTime = startTime;
+    emit startTimeChanged();
+
+    refresh();
+}
+
+void NemoCalendarUpcomingModel::resetStartTime()
+{
+    setStartTime(QDateTime());
+}
+
+int NemoCalendarUpcomingModel::count() const
+{
+    return mEvents.count();
+}
+
+int NemoCalendarUpcomingModel::rowCount(const QModelIndex &index) const
+{
+    if (index != QModelIndex())
+        return 0;
+
+    return mEvents.count();
+}
+
+QVariant NemoCalendarUpcomingModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mEvents.count())
+        return QVariant();
+
+    switch (role) {
+        case EventObjectRole:
+            return QVariant::fromValue<QObject *>(mEvents.at(index.row())->eventObject());
+        case OccurrenceObjectRole:
+            return QVariant::fromValue<QObject *>(mEvents.at(index.row()));
+        case SectionBucketRole:
+            return mEvents.at(index.row())->startTime().date();
+        case OngoingRole:
+            return mEvents.at(index.row())->startTime() <= mNow;
+        default:
+            return QVariant();
+    }
+}
+
+void NemoCalendarUpcomingModel::classBegin()
+{
+    mIsComplete = false;
+}
+
+void NemoCalendarUpcomingModel::componentComplete()
+{
+    mIsComplete = true;
+    refresh();
+}
+
+// Occurrences whose event has been deleted sort first, so they are removed
+static bool occurrenceLessThan(const mKCal::ExtendedCalendar::ExpandedIncidence &e1,
+                               const mKCal::ExtendedCalendar::ExpandedIncidence &e2)
+{
+    if (!e1.second || !e2.second)
+        return !e1.second && e2.second;
+    if (e1.first.dtStart != e2.first.dtStart)
+        return e1.first.dtStart < e2.first.dtStart;
+    return e1.second->uid() < e2.second->uid();
+}
+
+static bool occurrencesEqual(const mKCal::ExtendedCalendar::ExpandedIncidence &e1,
+                             const mKCal::ExtendedCalendar::ExpandedIncidence &e2)
+{
+    return e1.first.dtStart == e2.first.dtStart &&
+           e1.first.dtEnd == e2.first.dtEnd &&
+           e1.second && e2.second && e1.second->uid() == e2.second->uid();
+}
+
+// All day occurrences end at the end of their last day
+static QDateTime occurrenceLocalEnd(const mKCal::ExtendedCalendar::ExpandedIncidence &e)
+{
+    if (e.second->allDay())
+        return QDateTime(e.first.dtEnd.date().addDays(1), QTime(0, 0));
+    return e.first.dtEnd;
+}
+
+void NemoCalendarUpcomingModel::refresh()
+{
+    if (!mIsComplete)
+        return;
+
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    cache->ensureLoaded();
+
+    mBoundaryTimer.stop();
+
+    KDateTime from = mStartTime.isValid()?KDateTime(mStartTime, KDateTime::Spec(KDateTime::LocalZone))
+                                         :KDateTime::currentLocalDateTime();
+    QDateTime previousNow = mNow;
+    mNow = from.dateTime();
+
+    update(upcomingOccurrences(from, mLimit));
+    mIndexRevision = cache->mUpcomingIndex.revision();
+    mNotebooks = cache->mNotebooks;
+
+    emitOngoingChanged(previousNow);
+
+    if (!mStartTime.isValid())
+        scheduleRefresh();
+}
+
+// Storage changes that left the occurrence index and the notebooks shown
+// as they were cannot change the model
+void NemoCalendarUpcomingModel::storageChanged()
+{
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    if (mIndexRevision == cache->mUpcomingIndex.revision() && mNotebooks == cache->mNotebooks)
+        return;
+
+    refresh();
+}
+
+// Rows are in start order, so the ones that started or stopped being
+// ongoing as the time moved from previousNow are a single run
+void NemoCalendarUpcomingModel::emitOngoingChanged(const QDateTime &previousNow)
+{
+    if (!previousNow.isValid() || previousNow == mNow)
+        return;
+
+    QDateTime lower = qMin(previousNow, mNow);
+    QDateTime upper = qMax(previousNow, mNow);
+
+    int first = -1;
+    int last = -1;
+    for (int ii = 0; ii < mEvents.count(); ++ii) {
+        QDateTime start = mEvents.at(ii)->startTime();
+        if (start > upper)
+            break;
+        if (start > lower) {
+            if (first == -1)
+                first = ii;
+            last = ii;
+        }
+    }
+
+    if (first != -1)
+        emit dataChanged(index(first), index(last), QVector<int>() << OngoingRole);
+}
+
+// Merges occurrences into the model, keeping rows that are unchanged
+void NemoCalendarUpcomingModel::update(const mKCal::ExtendedCalendar::ExpandedIncidenceList &occurrences)
+{
+    int oldEventCount = mEvents.count();
+
+    int row = 0;
+    int ii = 0;
+    while (row < mEvents.count() || ii < occurrences.count()) {
+        if (row < mEvents.count() && ii < occurrences.count() &&
+            occurrencesEqual(mEvents.at(row)->expandedEvent(), occurrences.at(ii))) {
+            ++row;
+            ++ii;
+        } else if (row < mEvents.count() &&
+                   (ii >= occurrences.count() ||
+                    !occurrenceLessThan(occurrences.at(ii), mEvents.at(row)->expandedEvent()))) {
+            beginRemoveRows(QModelIndex(), row, row);
+            delete mEvents.takeAt(row);
+            endRemoveRows();
+            NemoCalendarStats::count(NemoCalendarStats::RowsRemoved);
+        } else {
+            beginInsertRows(QModelIndex(), row, row);
+            mEvents.insert(row, new NemoCalendarEventOccurrence(occurrences.at(ii), this));
+            endInsertRows();
+            NemoCalendarStats::count(NemoCalendarStats::RowsInserted);
+            ++row;
+            ++ii;
+        }
+    }
+
+    if (oldEventCount != mEvents.count())
+        emit countChanged();
+}
+
+// Arms the timer for the next time one of the occurrences starts or ends,
+// which is the next time the model contents can change.
+void NemoCalendarUpcomingModel::scheduleRefresh()
+{
+    QDateTime boundary;
+    for (int ii = 0; ii < mEvents.count(); ++ii) {
+        const mKCal::ExtendedCalendar::ExpandedIncidence &e = mEvents.at(ii)->expandedEvent();
+        QDateTime next = e.first.dtStart > mNow?e.first.dtStart:occurrenceLocalEnd(e);
+        if (next > mNow && (!boundary.isValid() || next < boundary))
+            boundary = next;
+    }
+
+    if (boundary.isValid())
+        mBoundaryTimer.start(boundary);
+}
+
+// Returns the first limit occurrences, in start order, of events in the
+// included notebooks that have not ended by from
+mKCal::ExtendedCalendar::ExpandedIncidenceList NemoCalendarUpcomingModel::upcomingOccurrences(const KDateTime &from,
+                                                                                             int limit)
+{
+    NemoCalendarEventCache *cache = NemoCalendarEventCache::instance();
+    return cache->mUpcomingIndex.upcoming(from, limit, NemoCalendarDb::calendar(), cache->mNotebooks);
+}
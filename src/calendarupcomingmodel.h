@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARUPCOMINGMODEL_H
+#define CALENDARUPCOMINGMODEL_H
+
+#include <QSet>
+#include <QDateTime>
+#include <QAbstractListModel>
+#include <QQmlParserStatus>
+
+#include "calendarclocktimer.h"
+
+// mkcal
+#include <extendedcalendar.h>
+
+class NemoCalendarEventOccurrence;
+
+class NemoCalendarUpcomingModel : public QAbstractListModel, public QQmlParserStatus
+{
+    Q_OBJECT
+    Q_INTERFACES(QQmlParserStatus)
+    Q_PROPERTY(int limit READ limit WRITE setLimit NOTIFY limitChanged)
+    Q_PROPERTY(QDateTime startTime READ startTime WRITE setStartTime RESET resetStartTime NOTIFY startTimeChanged)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    enum {
+        EventObjectRole = Qt::UserRole,
+        OccurrenceObjectRole,
+        SectionBucketRole,
+        OngoingRole
+    };
+
+    explicit NemoCalendarUpcomingModel(QObject *parent = 0);
+    virtual ~NemoCalendarUpcomingModel();
+
+    int limit() const;
+    void setLimit(int);
+
+    QDateTime startTime() const;
+    void setStartTime(const QDateTime &);
+    void resetStartTime();
+
+    int count() const;
+
+    virtual int rowCount(const QModelIndex &index) const;
+    virtual QVariant data(const QModelIndex &index, int role) const;
+
+    virtual void classBegin();
+    virtual void componentComplete();
+
+    static mKCal::ExtendedCalendar::ExpandedIncidenceList upcomingOccurrences(const KDateTime &from, int limit);
+
+signals:
+    void limitChanged();
+    void startTimeChanged();
+    void countChanged();
+
+protected:
+    virtual QHash<int, QByteArray> roleNames() const;
+
+private slots:
+    void refresh();
+    void storageChanged();
+
+private:
+    void update(const mKCal::ExtendedCalendar::ExpandedIncidenceList &);
+    void emitOngoingChanged(const QDateTime &previousNow);
+    void scheduleRefresh();
+
+    bool mIsComplete;
+    int mLimit;
+    QDateTime mStartTime;
+    QDateTime mNow;
+    NemoCalendarClockTimer mBoundaryTimer;
+    int mIndexRevision;
+    QSet<QString> mNotebooks;
+    QList<NemoCalendarEventOccurrence *> mEvents;
+    QHash<int, QByteArray> mRoleNames;
+};
+
+#endif // CALENDARUPCOMINGMODEL_H
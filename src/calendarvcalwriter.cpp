@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "calendarvcalwriter.h"
+
+#include <QBitArray>
+
+#include <vcalformat.h>
+#include <libical/vobject.h>
+#include <libical/vcaltmp.h>
+
+static void appendDateTime(QByteArray &out, const QDateTime &dt, bool zulu)
+{
+    char buf[20];
+    qsnprintf(buf, sizeof(buf), "%.2d%.2d%.2dT%.2d%.2d%.2d",
+              dt.date().year(), dt.date().month(), dt.date().day(),
+              dt.time().hour(), dt.time().minute(), dt.time().second());
+    out += buf;
+    if (zulu)
+        out += 'Z';
+}
+
+static void appendKDateTime(QByteArray &out, const KDateTime &dt, bool zulu = true)
+{
+    appendDateTime(out, zulu?dt.toUtc().dateTime():dt.toLocalZone().dateTime(), zulu);
+}
+
+static void appendDate(QByteArray &out, const QDate &date)
+{
+    char buf[12];
+    qsnprintf(buf, sizeof(buf), "%.2d%.2d%.2d", date.year(), date.month(), date.day());
+    out += buf;
+}
+
+static void appendInt(QByteArray &out, int value)
+{
+    out += QByteArray::number(value);
+}
+
+static bool needsQuotedPrintable(const QByteArray &in)
+{
+    for (int ii = 0; ii < in.size(); ++ii) {
+        uchar c = in.at(ii);
+        if (c < 0x20 || c >= 0x7f || c == '=')
+            return true;
+    }
+    return false;
+}
+
+// Quoted-printable encoding as per RFC 2045, with soft line breaks keeping
+// encoded lines within 76 characters
+static void appendQuotedPrintable(QByteArray &out, const QByteArray &in)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    int lineLength = 0;
+    for (int ii = 0; ii < in.size(); ++ii) {
+        uchar c = in.at(ii);
+        bool encode = c < 0x20 || c >= 0x7f || c == '=' ||
+                      ((c == ' ' || c == '\t') && (ii + 1 == in.size() || in.at(ii + 1) == '\n'));
+        int width = encode?3:1;
+
+        if (lineLength + width > 75) {
+            out += "=\r\n";
+            lineLength = 0;
+        }
+
+        if (encode) {
+            out += '=';
+            out += hex[c >> 4];
+            out += hex[c & 0xf];
+        } else {
+            out += char(c);
+        }
+        lineLength += width;
+    }
+}
+
+static void appendText(QByteArray &out, const char *name, const QString &text)
+{
+    if (text.isEmpty())
+        return;
+
+    QByteArray in = text.toUtf8();
+    out += name;
+    if (needsQuotedPrintable(in)) {
+        out += ";ENCODING=QUOTED-PRINTABLE;CHARSET=UTF-8:";
+        appendQuotedPrintable(out, in);
+    } else {
+        out += ':';
+        out += in;
+    }
+    out += "\r\n";
+}
+
+bool NemoCalendarVCalWriter::canWrite(const KCalCore::Event::Ptr &event)
+{
+    if (!event)
+        return false;
+
+    if (!event->attendees().isEmpty() || !event->attachments().isEmpty() ||
+        !event->resources().isEmpty() || !event->relatedTo().isEmpty() ||
+        !event->customProperties().isEmpty())
+        return false;
+
+    KCalCore::Alarm::List alarms = event->alarms();
+    for (int ii = 0; ii < alarms.count(); ++ii) {
+        if (alarms.at(ii)->enabled() && alarms.at(ii)->type() != KCalCore::Alarm::Display &&
+            alarms.at(ii)->type() != KCalCore::Alarm::Invalid)
+            return false;
+    }
+
+    const KCalCore::Recurrence *recurrence = event->recurrence();
+    if (recurrence->recurs()) {
+        if (recurrence->rRules().count() != 1 || !recurrence->exRules().isEmpty() ||
+            !recurrence->rDates().isEmpty() || !recurrence->rDateTimes().isEmpty())
+            return false;
+
+        switch (recurrence->recurrenceType()) {
+        case KCalCore::Recurrence::rDaily:
+        case KCalCore::Recurrence::rWeekly:
+        case KCalCore::Recurrence::rMonthlyDay:
+        case KCalCore::Recurrence::rYearlyMonth:
+            break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Appends the VEVENT component for event, which must satisfy canWrite().
+// Properties are written in the order VCalFormat::eventToVEvent() adds them.
+void NemoCalendarVCalWriter::writeVEvent(QByteArray &out, const KCalCore::Event::Ptr &event)
+{
+    static const char *const dayNames[] = { "MO ", "TU ", "WE ", "TH ", "FR ", "SA ", "SU " };
+
+    out += "BEGIN:VEVENT\r\n";
+
+    out += "DTSTART:";
+    appendKDateTime(out, event->dtStart(), !event->allDay());
+    out += "\r\n";
+
+    if (event->dtStart() != event->dtEnd()) {
+        out += "DTEND:";
+        appendKDateTime(out, event->dtEnd(), !event->allDay());
+        out += "\r\n";
+    }
+
+    out += "DCREATED:";
+    appendKDateTime(out, event->created());
+    out += "\r\nUID:";
+    out += event->uid().toUtf8();
+    out += "\r\nSEQUENCE:";
+    appendInt(out, event->revision());
+    out += "\r\nLAST-MODIFIED:";
+    appendKDateTime(out, event->lastModified());
+    out += "\r\n";
+
+    if (!event->organizer()->email().isEmpty()) {
+        out += "ORGANIZER:MAILTO:";
+        out += event->organizer()->email().toUtf8();
+        out += "\r\n";
+    }
+
+    const KCalCore::Recurrence *recurrence = event->recurrence();
+    if (recurrence->recurs()) {
+        out += "RRULE:";
+        switch (recurrence->recurrenceType()) {
+        case KCalCore::Recurrence::rDaily:
+            out += 'D';
+            appendInt(out, recurrence->frequency());
+            out += ' ';
+            break;
+        case KCalCore::Recurrence::rWeekly: {
+            out += 'W';
+            appendInt(out, recurrence->frequency());
+            out += ' ';
+            QBitArray days = recurrence->days();
+            for (int ii = 0; ii < 7; ++ii) {
+                if (days.testBit(ii))
+                    out += dayNames[ii];
+            }
+            break;
+        }
+        case KCalCore::Recurrence::rMonthlyDay: {
+            out += "MD";
+            appendInt(out, recurrence->frequency());
+            out += ' ';
+            QList<int> monthDays = recurrence->monthDays();
+            for (int ii = 0; ii < monthDays.count(); ++ii) {
+                appendInt(out, monthDays.at(ii));
+                out += ' ';
+            }
+            break;
+        }
+        case KCalCore::Recurrence::rYearlyMonth: {
+            out += "YM";
+            appendInt(out, recurrence->frequency());
+            out += ' ';
+            QList<int> months = recurrence->yearMonths();
+            for (int ii = 0; ii < months.count(); ++ii) {
+                appendInt(out, months.at(ii));
+                out += ' ';
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (recurrence->duration() > 0) {
+            out += '#';
+            appendInt(out, recurrence->duration());
+        } else if (recurrence->duration() == -1) {
+            out += "#0";
+        } else {
+            appendKDateTime(out, recurrence->endDateTime(), false);
+        }
+        out += "\r\n";
+
+        KCalCore::DateList exDates = recurrence->exDates();
+        if (!exDates.isEmpty()) {
+            out += "EXDATE:";
+            for (int ii = 0; ii < exDates.count(); ++ii) {
+                if (ii)
+                    out += ';';
+                appendDate(out, exDates.at(ii));
+            }
+            out += "\r\n";
+        }
+
+        KCalCore::DateTimeList exDateTimes = recurrence->exDateTimes();
+        if (!exDateTimes.isEmpty()) {
+            out += "EXDATE:";
+            for (int ii = 0; ii < exDateTimes.count(); ++ii) {
+                if (ii)
+                    out += ';';
+                appendKDateTime(out, exDateTimes.at(ii));
+            }
+            out += "\r\n";
+        }
+    }
+
+    appendText(out, "DESCRIPTION", event->description());
+    appendText(out, "SUMMARY", event->summary());
+    appendText(out, "LOCATION", event->location());
+    appendText(out, "CATEGORIES", event->categories().join(QLatin1String(";")));
+
+    KCalCore::Alarm::List alarms = event->alarms();
+    for (int ii = 0; ii < alarms.count(); ++ii) {
+        const KCalCore::Alarm::Ptr &alarm = alarms.at(ii);
+        if (!alarm->enabled() || alarm->type() != KCalCore::Alarm::Display)
+            continue;
+
+        out += "DALARM:";
+        appendKDateTime(out, alarm->time());
+        out += ";;1;";
+        out += alarm->text().isNull()?QByteArray("beep!"):alarm->text().toLatin1();
+        out += "\r\n";
+    }
+
+    out += "PRIORITY:";
+    appendInt(out, event->priority());
+    out += "\r\nTRANSP:";
+    appendInt(out, event->transparency());
+    out += "\r\n";
+
+    switch (event->secrecy()) {
+    case KCalCore::Incidence::SecrecyPublic:
+        out += "CLASS:PUBLIC\r\n";
+        break;
+    case KCalCore::Incidence::SecrecyPrivate:
+        out += "CLASS:PRIVATE\r\n";
+        break;
+    case KCalCore::Incidence::SecrecyConfidential:
+        out += "CLASS:CONFIDENTIAL\r\n";
+        break;
+    }
+
+    out += "END:VEVENT\r\n\r\n";
+}
+
+// Returns a complete vCalendar object holding event
+QByteArray NemoCalendarVCalWriter::vCalendar(const KCalCore::Event::Ptr &event, const QString &prodId,
+                                             const QDateTime &created)
+{
+    QByteArray out;
+    out.reserve(1024);
+
+    out += "BEGIN:VCALENDAR\r\nDCREATED:";
+    out += created.toString(Qt::ISODate).toUtf8();
+    out += "\r\nPRODID:";
+    out += prodId.toUtf8();
+    out += "\r\nVERSION:1.0\r\n";
+    writeVEvent(out, event);
+    out += "END:VCALENDAR\r\n\r\n";
+
+    return out;
+}
+
+// eventToVEvent() is protected
+class NemoCalendarVCalFormat : public KCalCore::VCalFormat
+{
+public:
+    QByteArray convertEventToVEvent(const KCalCore::Event::Ptr &event, const QString &prodId,
+                                    const QDateTime &created)
+    {
+        VObject *vCalObj = vcsCreateVCal(
+            created.toString(Qt::ISODate).toLatin1().data(),
+            NULL,
+            prodId.toLatin1().data(),
+            NULL,
+            "1.0");
+        VObject *vEventObj = eventToVEvent(event);
+        addVObjectProp(vCalObj, vEventObj);
+        char *memVObject = writeMemVObject(0, 0, vCalObj);
+        QByteArray retn(memVObject);
+        free(memVObject);
+        cleanVObject(vCalObj);
+        return retn;
+    }
+};
+
+QByteArray NemoCalendarVCalWriter::referenceVCalendar(const KCalCore::Event::Ptr &event, const QString &prodId,
+                                                      const QDateTime &created)
+{
+    NemoCalendarVCalFormat fmt;
+    return fmt.convertEventToVEvent(event, prodId, created);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef CALENDARVCALWRITER_H
+#define CALENDARVCALWRITER_H
+
+#include <QDateTime>
+#include <QByteArray>
+
+// mkcal
+#include <event.h>
+
+// Writes vCalendar 1.0 text straight from event fields, producing the same
+// output as KCalCore::VCalFormat without building a VObject tree.  Only
+// events using the subset of features that canWrite() accepts are supported.
+class NemoCalendarVCalWriter
+{
+public:
+    static bool canWrite(const KCalCore::Event::Ptr &event);
+
+    static void writeVEvent(QByteArray &out, const KCalCore::Event::Ptr &event);
+    static QByteArray vCalendar(const KCalCore::Event::Ptr &event, const QString &prodId,
+                                const QDateTime &created);
+
+    // The same document written through VCalFormat, for events canWrite()
+    // rejects and to check the direct writer against
+    static QByteArray referenceVCalendar(const KCalCore::Event::Ptr &event, const QString &prodId,
+                                         const QDateTime &created);
+};
+
+#endif // CALENDARVCALWRITER_H
@@ -40,7 +40,11 @@
 # define QDeclarativeExtensionPlugin QQmlExtensionPlugin
 #include "calendarapi.h"
 #include "calendareventquery.h"
+#include "calendareventlistquery.h"
 #include "calendarnotebookmodel.h"
+#include "calendarsearchmodel.h"
+#include "calendarupcomingmodel.h"
+#include "calendarstats.h"
 #else
 # include <QtDeclarative/qdeclarative.h>
 # include <QtDeclarative/QDeclarativeExtensionPlugin>
@@ -98,7 +102,11 @@ public:
         qmlRegisterType<NemoCalendarAgendaModel>(uri, 1, 0, "AgendaModel");
 #ifdef NEMO_USE_QT5
         qmlRegisterType<NemoCalendarEventQuery>(uri, 1, 0, "EventQuery");
+        qmlRegisterType<NemoCalendarEventListQuery>(uri, 1, 0, "EventListQuery");
         qmlRegisterType<NemoCalendarNotebookModel>(uri, 1, 0, "NotebookModel");
+        qmlRegisterType<NemoCalendarSearchModel>(uri, 1, 0, "SearchModel");
+        qmlRegisterType<NemoCalendarUpcomingModel>(uri, 1, 0, "UpcomingModel");
+        qmlRegisterUncreatableType<NemoCalendarStats>(uri, 1, 0, "CalendarStats", "Use Calendar.stats");
         qmlRegisterSingletonType<QtDate>(uri, 1, 0, "QtDate", QtDate::New);
         qmlRegisterSingletonType<NemoCalendarApi>(uri, 1, 0, "Calendar", NemoCalendarApi::New);
 #endif
@@ -17,14 +17,26 @@ equals(QT_MAJOR_VERSION, 5) {
 
     SOURCES += \
         calendarapi.cpp \
+        calendarclocktimer.cpp \
         calendareventquery.cpp \
+        calendareventlistquery.cpp \
+        calendarimporter.cpp \
+        calendarexporter.cpp \
         calendarnotebookmodel.cpp \
+        calendarsearchmodel.cpp \
+        calendarupcomingmodel.cpp \
 
     HEADERS += \
         calendarapi.cpp \
         calendarapi.h \
+        calendarclocktimer.h \
         calendareventquery.h \
+        calendareventlistquery.h \
+        calendarimporter.h \
+        calendarexporter.h \
         calendarnotebookmodel.h \
+        calendarsearchmodel.h \
+        calendarupcomingmodel.h \
 
     DEFINES += NEMO_USE_QT5
 }
@@ -39,18 +51,39 @@ INSTALLS += qmldir
 
 CONFIG += link_pkgconfig
 
+# shm_open for the shared occurrence index
+LIBS += -lrt
+
 SOURCES += \
     plugin.cpp \
     calendarevent.cpp \
     calendaragendamodel.cpp \
     calendardb.cpp \
     calendareventcache.cpp \
+    calendarsearchindex.cpp \
+    calendaralarmindex.cpp \
+    calendarupcomingindex.cpp \
+    calendaroccurrencestore.cpp \
+    calendarlocalzone.cpp \
+    calendarstats.cpp \
+    calendarrecorder.cpp \
+    calendarsnapshot.cpp \
+    calendarvcalwriter.cpp \
 
 HEADERS += \
     calendarevent.h \
     calendaragendamodel.h \
     calendardb.h \
     calendareventcache.h \
+    calendarsearchindex.h \
+    calendaralarmindex.h \
+    calendarupcomingindex.h \
+    calendaroccurrencestore.h \
+    calendarlocalzone.h \
+    calendarstats.h \
+    calendarrecorder.h \
+    calendarsnapshot.h \
+    calendarvcalwriter.h \
 
 MOC_DIR = $$PWD/.moc
 OBJECTS_DIR = $$PWD/.obj
@@ -0,0 +1,9 @@
+# Shared settings for the unit tests.  They compile the engine sources the
+# same way as the command line tools and use their synthetic calendars.
+
+include(../tools/tools.pri)
+
+QT += testlib
+CONFIG += testcase
+
+target.path = /opt/tests/nemo-qml-plugin-calendar-qt5
@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+# Like the tools, the tests build the plugin's engine sources directly, so
+# they follow the Qt 5 build of the plugin
+equals(QT_MAJOR_VERSION, 5) {
+    SUBDIRS = tst_agendastress tst_calendarbenchmark tst_vcalwriter
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "modelchecker.h"
+
+#include <QAbstractItemModel>
+
+ModelChecker::ModelChecker(QAbstractItemModel *model)
+: QObject(model), mModel(model), mExpectedCount(-1), mRowsInserted(0), mRowsRemoved(0), mResets(0)
+{
+    connect(model, SIGNAL(rowsAboutToBeInserted(QModelIndex,int,int)),
+            this, SLOT(rowsAboutToBeInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)),
+            this, SLOT(rowsInserted(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)),
+            this, SLOT(rowsAboutToBeRemoved(QModelIndex,int,int)));
+    connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)),
+            this, SLOT(rowsRemoved(QModelIndex,int,int)));
+    connect(model, SIGNAL(modelReset()), this, SLOT(modelReset()));
+}
+
+void ModelChecker::clear()
+{
+    mErrors.clear();
+    mRowsInserted = 0;
+    mRowsRemoved = 0;
+    mResets = 0;
+}
+
+void ModelChecker::rowsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+    int count = mModel->rowCount(QModelIndex());
+    check(!parent.isValid(), "insert with a valid parent");
+    check(first >= 0 && first <= last && first <= count,
+          QString("insert of rows %1-%2 into %3 rows").arg(first).arg(last).arg(count));
+    mExpectedCount = count + last - first + 1;
+}
+
+void ModelChecker::rowsInserted(const QModelIndex &, int first, int last)
+{
+    int count = mModel->rowCount(QModelIndex());
+    check(count == mExpectedCount,
+          QString("%1 rows after inserting rows %2-%3, expected %4").arg(count).arg(first).arg(last).arg(mExpectedCount));
+    mRowsInserted += last - first + 1;
+}
+
+void ModelChecker::rowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    int count = mModel->rowCount(QModelIndex());
+    check(!parent.isValid(), "remove with a valid parent");
+    check(first >= 0 && first <= last && last < count,
+          QString("removal of rows %1-%2 from %3 rows").arg(first).arg(last).arg(count));
+    mExpectedCount = count - (last - first + 1);
+}
+
+void ModelChecker::rowsRemoved(const QModelIndex &, int first, int last)
+{
+    int count = mModel->rowCount(QModelIndex());
+    check(count == mExpectedCount,
+          QString("%1 rows after removing rows %2-%3, expected %4").arg(count).arg(first).arg(last).arg(mExpectedCount));
+    mRowsRemoved += last - first + 1;
+}
+
+void ModelChecker::modelReset()
+{
+    ++mResets;
+}
+
+void ModelChecker::check(bool condition, const QString &error)
+{
+    if (!condition)
+        mErrors.append(error);
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+// Applies bursts of random edits to a synthetic calendar, as arrive from a
+// sync, checking the agenda models open on it after each burst.  Every
+// seed gives the same edits, so a failure reproduces by running its row,
+// e.g. tst_agendastress stress:"seed 2".
+
+#include <QtTest>
+#include <QSettings>
+#include <QTemporaryDir>
+
+#include "calendardb.h"
+#include "calendarevent.h"
+#include "calendareventcache.h"
+#include "calendaragendamodel.h"
+#include "syntheticcalendar.h"
+#include "modelchecker.h"
+
+class tst_AgendaStress : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+
+    void stress_data();
+    void stress();
+
+private:
+    struct Row {
+        QString uid;
+        QDateTime start;
+        QDateTime end;
+
+        bool operator==(const Row &other) const
+        {
+            return uid == other.uid && start == other.start && end == other.end;
+        }
+    };
+
+    void openAgenda(const QDate &start, const QDate &end);
+    QString randomEdit(quint32 &state, const QDate &start, const QDate &end, int index);
+    static QList<Row> modelRows(NemoCalendarAgendaModel *model);
+    static QList<Row> expectedRows(NemoCalendarAgendaModel *model);
+    static int countRows(const QList<Row> &rows, const QSet<QString> &uids);
+
+    QTemporaryDir mDirectory;
+    QDate mStart;
+    QList<NemoCalendarAgendaModel *> mAgendas;
+    int mEdits;
+};
+
+static quint32 nextRandom(quint32 &state, int n)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return n > 0 ? state % quint32(n) : 0;
+}
+
+void tst_AgendaStress::initTestCase()
+{
+    QVERIFY(mDirectory.isValid());
+
+    qputenv("NEMO_CALENDAR_SNAPSHOT", "0");
+    SyntheticCalendar::useDatabase(mDirectory.path() + "/db");
+
+    SyntheticCalendar::Options options;
+    options.seed = 1;
+    options.events = 1000;
+    SyntheticCalendar calendar(options);
+    QVERIFY(calendar.populate());
+
+    NemoCalendarEventCache::instance()->ensureLoaded();
+    mStart = options.startDate.addDays(options.days / 2);
+    mEdits = 0;
+}
+
+void tst_AgendaStress::cleanup()
+{
+    qDeleteAll(mAgendas);
+    mAgendas.clear();
+}
+
+void tst_AgendaStress::stress_data()
+{
+    QTest::addColumn<quint32>("seed");
+    QTest::addColumn<int>("bursts");
+
+    // Each row continues from the calendar the rows before it left
+    QTest::newRow("seed 1") << quint32(1) << 50;
+    QTest::newRow("seed 2") << quint32(2) << 50;
+    QTest::newRow("seed 3") << quint32(3) << 50;
+    QTest::newRow("seed 2014") << quint32(2014) << 50;
+}
+
+// Applies bursts of one to three random edits, then reloads and checks
+// that every open agenda model matches a fresh expansion of its range,
+// emitted consistent row signals, and changed a number of rows in
+// proportion to the occurrences of the edited events
+void tst_AgendaStress::stress()
+{
+    QFETCH(quint32, seed);
+    QFETCH(int, bursts);
+
+    openAgenda(mStart, mStart);
+    openAgenda(mStart, mStart.addDays(6));
+    openAgenda(mStart.addDays(-3), mStart.addDays(27));
+
+    QDate start = mStart.addDays(-3);
+    QDate end = mStart.addDays(27);
+    quint32 state = seed;
+    QStringList failures;
+
+    for (int ii = 0; ii < bursts; ++ii) {
+        QList<QList<Row> > before;
+        for (int jj = 0; jj < mAgendas.count(); ++jj) {
+            before.append(modelRows(mAgendas.at(jj)));
+            mAgendas.at(jj)->findChild<ModelChecker *>()->clear();
+        }
+
+        QSet<QString> touched;
+        int burst = 1 + nextRandom(state, 3);
+        for (int jj = 0; jj < burst; ++jj) {
+            QString uid = randomEdit(state, start, end, mEdits++);
+            if (!uid.isEmpty())
+                touched.insert(uid);
+        }
+        NemoCalendarDb::save();
+
+        NemoCalendarEventCache::instance()->load();
+        SyntheticCalendar::drainRefresh();
+
+        for (int jj = 0; jj < mAgendas.count(); ++jj) {
+            NemoCalendarAgendaModel *model = mAgendas.at(jj);
+            ModelChecker *checker = model->findChild<ModelChecker *>();
+            QStringList errors = checker->errors();
+
+            QList<Row> actual = modelRows(model);
+            QList<Row> expected = expectedRows(model);
+            if (actual != expected) {
+                int row = 0;
+                while (row < actual.count() && row < expected.count() && actual.at(row) == expected.at(row))
+                    ++row;
+                errors.append(QString("rows differ from a fresh expansion at row %1 (%2 rows, expected %3)")
+                              .arg(row).arg(actual.count()).arg(expected.count()));
+            }
+
+            int changed = checker->rowsInserted() + checker->rowsRemoved();
+            int bound = 2 * (countRows(before.at(jj), touched) + countRows(expected, touched)) + 4;
+            if (checker->resets())
+                errors.append("model was reset");
+            else if (changed > bound)
+                errors.append(QString("%1 rows changed for %2 edits, expected at most %3")
+                              .arg(changed).arg(burst).arg(bound));
+
+            for (int kk = 0; kk < errors.count(); ++kk)
+                failures.append(QString("burst %1, agenda %2: %3").arg(ii).arg(jj).arg(errors.at(kk)));
+        }
+    }
+
+    QVERIFY2(failures.isEmpty(), qPrintable(failures.join(QLatin1String("\n"))));
+}
+
+void tst_AgendaStress::openAgenda(const QDate &start, const QDate &end)
+{
+    NemoCalendarAgendaModel *model = new NemoCalendarAgendaModel;
+    model->setStartDate(start);
+    model->setEndDate(end);
+    SyntheticCalendar::drainRefresh();
+    new ModelChecker(model);
+    mAgendas.append(model);
+}
+
+// Makes one change to the calendar, returning the uid of the event changed
+QString tst_AgendaStress::randomEdit(quint32 &state, const QDate &start, const QDate &end, int index)
+{
+    static const char *summaries[] = { "alpha", "Bravo", "charlie", "delta", "Echo", "foxtrot" };
+
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    KCalCore::Event::List events = calendar->rawEvents();
+    int days = start.daysTo(end) + 1;
+    int kind = nextRandom(state, 5);
+
+    if (kind == 4 || events.isEmpty()) {
+        KCalCore::Event::Ptr event(new KCalCore::Event);
+        event->setUid(QString("stress-%1").arg(index));
+        event->setSummary(summaries[nextRandom(state, 6)]);
+        KDateTime dtStart(start.addDays(nextRandom(state, days)), QTime(8, 0).addSecs(nextRandom(state, 4) * 60 * 60),
+                          KDateTime::Spec(KDateTime::LocalZone));
+        event->setDtStart(dtStart);
+        event->setDtEnd(dtStart.addSecs(60 * 60));
+        if (nextRandom(state, 3) == 0)
+            event->recurrence()->setDaily(1 + nextRandom(state, 3));
+        calendar->addEvent(event, NemoCalendarDb::storage()->defaultNotebook()->uid());
+        return event->uid();
+    }
+
+    KCalCore::Event::Ptr event = events.at(nextRandom(state, events.count()));
+    if (event->hasRecurrenceId())
+        return QString();
+
+    switch (kind) {
+    case 0: {
+        // Occurrences starting at the same time are ordered by summary
+        int secs = (int(nextRandom(state, 7)) - 3) * 24 * 60 * 60 + (int(nextRandom(state, 8)) - 4) * 60 * 60;
+        if (event->allDay())
+            secs -= secs % (24 * 60 * 60);
+        event->setDtStart(event->dtStart().addSecs(secs));
+        event->setDtEnd(event->dtEnd().addSecs(secs));
+        break;
+    }
+    case 1:
+        event->setSummary(summaries[nextRandom(state, 6)]);
+        break;
+    case 2:
+        if (event->recurs()) {
+            KDateTime from(start.addDays(nextRandom(state, days)), QTime(0, 0), KDateTime::Spec(KDateTime::LocalZone));
+            KDateTime occurrence = event->recurrence()->getNextDateTime(from);
+            if (occurrence.isValid())
+                event->recurrence()->addExDateTime(occurrence);
+        } else {
+            event->setSummary(summaries[nextRandom(state, 6)]);
+        }
+        break;
+    default:
+        calendar->deleteEvent(event);
+        return event->uid();
+    }
+
+    event->setRevision(event->revision() + 1);
+    return event->uid();
+}
+
+QList<tst_AgendaStress::Row> tst_AgendaStress::modelRows(NemoCalendarAgendaModel *model)
+{
+    QList<Row> rv;
+    for (int ii = 0; ii < model->rowCount(QModelIndex()); ++ii) {
+        QObject *object = model->data(model->index(ii), NemoCalendarAgendaModel::OccurrenceObjectRole).value<QObject *>();
+        NemoCalendarEventOccurrence *occurrence = qobject_cast<NemoCalendarEventOccurrence *>(object);
+        Row row;
+        row.uid = occurrence->event() ? occurrence->event()->uid() : QString();
+        row.start = occurrence->startTime();
+        row.end = occurrence->endTime();
+        rv.append(row);
+    }
+    return rv;
+}
+
+static bool rowLessThan(const QPair<mKCal::ExtendedCalendar::ExpandedIncidence, QString> &r1,
+                        const QPair<mKCal::ExtendedCalendar::ExpandedIncidence, QString> &r2)
+{
+    if (r1.first.first.dtStart != r2.first.first.dtStart)
+        return r1.first.first.dtStart < r2.first.first.dtStart;
+
+    int cmp = QString::compare(r1.first.second->summary(), r2.first.second->summary(), Qt::CaseInsensitive);
+    return cmp == 0 ? QString::compare(r1.second, r2.second) < 0 : cmp < 0;
+}
+
+// The rows an agenda model on the same range should have, from a fresh
+// expansion sorted as the model sorts its rows
+QList<tst_AgendaStress::Row> tst_AgendaStress::expectedRows(NemoCalendarAgendaModel *model)
+{
+    QSettings settings("nemo", "nemo-qml-plugin-calendar");
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    QDate start = model->startDate();
+    QDate end = model->endDate().isValid() ? model->endDate() : start;
+
+    mKCal::ExtendedCalendar::ExpandedIncidenceList expanded =
+        calendar->rawExpandedEvents(start, end, false, false, KDateTime::Spec(KDateTime::LocalZone));
+
+    QList<QPair<mKCal::ExtendedCalendar::ExpandedIncidence, QString> > sorted;
+    for (int ii = 0; ii < expanded.count(); ++ii) {
+        const mKCal::ExtendedCalendar::ExpandedIncidenceValidity &validity = expanded.at(ii).first;
+        if (settings.value("exclude/" + calendar->notebook(expanded.at(ii).second), false).toBool())
+            continue;
+        if ((validity.dtStart.date() < start && validity.dtEnd.date() >= start)
+                || (validity.dtStart.date() >= start && validity.dtStart.date() <= end))
+            sorted.append(qMakePair(expanded.at(ii), expanded.at(ii).second->uid()));
+    }
+    qSort(sorted.begin(), sorted.end(), rowLessThan);
+
+    QList<Row> rv;
+    for (int ii = 0; ii < sorted.count(); ++ii) {
+        Row row;
+        row.uid = sorted.at(ii).second;
+        row.start = sorted.at(ii).first.first.dtStart;
+        row.end = sorted.at(ii).first.first.dtEnd;
+        rv.append(row);
+    }
+    return rv;
+}
+
+int tst_AgendaStress::countRows(const QList<Row> &rows, const QSet<QString> &uids)
+{
+    int rv = 0;
+    for (int ii = 0; ii < rows.count(); ++ii) {
+        if (uids.contains(rows.at(ii).uid))
+            ++rv;
+    }
+    return rv;
+}
+
+QTEST_GUILESS_MAIN(tst_AgendaStress)
+
+#include "tst_agendastress.moc"
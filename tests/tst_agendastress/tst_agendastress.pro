@@ -0,0 +1,10 @@
+TARGET = tst_agendastress
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_agendastress.cpp \
+    modelchecker.cpp \
+
+HEADERS += \
+    modelchecker.h \
@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+// Benchmarks of the engine against a synthetic calendar: loading, agenda
+// refresh, occurrence expansion, search, occurrence resolution and saving.
+// Run with the usual QtTest options, e.g. -iterations 10, or -callgrind to
+// count instructions.
+//
+// The calendar has NEMO_CALENDAR_BENCH_EVENTS events, 1000 by default, as
+// the database is fixed for the life of the process; run once per size to
+// compare, e.g.
+//
+//   for n in 1000 10000 100000 500000; do NEMO_CALENDAR_BENCH_EVENTS=$n tst_calendarbenchmark; done
+//
+// The database is generated in a temporary directory, or kept in
+// NEMO_CALENDAR_BENCH_DATABASE if set, which saves generating large
+// calendars again.  The saving benchmarks modify it.
+
+#include <QtTest>
+#include <QProcess>
+#include <QTemporaryDir>
+
+// mkcal
+#include <notebook.h>
+
+#include "calendardb.h"
+#include "calendarevent.h"
+#include "calendareventcache.h"
+#include "calendaragendamodel.h"
+#include "calendareventquery.h"
+#include "calendaroccurrencestore.h"
+#include "calendarsearchindex.h"
+#include "calendarupcomingindex.h"
+#include "syntheticcalendar.h"
+
+class tst_CalendarBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SyntheticCalendar::Options options();
+
+private slots:
+    void initTestCase();
+
+    void coldLoad();
+    void reload();
+    void refresh_data();
+    void refresh();
+    void expansion_data();
+    void expansion();
+    void upcoming_data();
+    void upcoming();
+    void search_data();
+    void search();
+    void refine_data();
+    void refine();
+    void eventQuery();
+    void editRefresh();
+    void saveSingle();
+    void saveBatch();
+
+private:
+    void addRangeRows();
+    static KCalCore::Event::List sampleEvents(int count, bool recurring);
+
+    QTemporaryDir mDirectory;
+    QDate mStart;
+    QSet<QString> mNotebooks;
+};
+
+// Centred on today, as the upcoming index only follows times from now on
+SyntheticCalendar::Options tst_CalendarBenchmark::options()
+{
+    SyntheticCalendar::Options options;
+    options.seed = 1;
+    int events = qgetenv("NEMO_CALENDAR_BENCH_EVENTS").toInt();
+    if (events > 0)
+        options.events = events;
+    options.startDate = QDate::currentDate().addDays(-options.days / 2);
+    return options;
+}
+
+void tst_CalendarBenchmark::initTestCase()
+{
+    QVERIFY(mDirectory.isValid());
+
+    // Snapshots would let the cache skip the storage it is measured against
+    qputenv("NEMO_CALENDAR_SNAPSHOT", "0");
+
+    QString database = QString::fromLocal8Bit(qgetenv("NEMO_CALENDAR_BENCH_DATABASE"));
+    if (database.isEmpty())
+        database = mDirectory.path() + "/db";
+    SyntheticCalendar::useDatabase(database);
+
+    if (!QFile::exists(database)) {
+        // Generated in a separate process so that loading is measured from
+        // storage rather than from what the generator left in memory
+        QProcess generator;
+        QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+        environment.insert("NEMO_CALENDAR_BENCH_GENERATE", "1");
+        generator.setProcessEnvironment(environment);
+        generator.setProcessChannelMode(QProcess::ForwardedChannels);
+        generator.start(QCoreApplication::applicationFilePath(), QStringList());
+        QVERIFY(generator.waitForFinished(-1));
+        QCOMPARE(generator.exitCode(), 0);
+    }
+
+    mStart = options().startDate.addDays(options().days / 2);
+
+    mKCal::Notebook::List notebooks = NemoCalendarDb::storage()->notebooks();
+    for (int ii = 0; ii < notebooks.count(); ++ii)
+        mNotebooks.insert(notebooks.at(ii)->uid());
+    QVERIFY(!mNotebooks.isEmpty());
+}
+
+// Opening the cache, which loads the storage and builds the indexes.  This
+// can only happen once per process.
+void tst_CalendarBenchmark::coldLoad()
+{
+    QBENCHMARK_ONCE {
+        NemoCalendarEventCache::instance();
+    }
+
+    QVERIFY(!NemoCalendarDb::calendar()->rawEvents().isEmpty());
+}
+
+void tst_CalendarBenchmark::reload()
+{
+    QBENCHMARK {
+        NemoCalendarEventCache::instance()->load();
+    }
+}
+
+void tst_CalendarBenchmark::addRangeRows()
+{
+    QTest::addColumn<int>("days");
+
+    QTest::newRow("day") << 1;
+    QTest::newRow("week") << 7;
+    QTest::newRow("month") << 31;
+    QTest::newRow("year") << 365;
+}
+
+void tst_CalendarBenchmark::refresh_data()
+{
+    addRangeRows();
+}
+
+// A new agenda model for the range, up to its rows being ready
+void tst_CalendarBenchmark::refresh()
+{
+    QFETCH(int, days);
+
+    int count = 0;
+    QBENCHMARK {
+        NemoCalendarAgendaModel model;
+        model.setStartDate(mStart);
+        model.setEndDate(mStart.addDays(days - 1));
+        SyntheticCalendar::drainRefresh();
+        count = model.count();
+    }
+
+    QVERIFY(count > 0);
+}
+
+void tst_CalendarBenchmark::expansion_data()
+{
+    addRangeRows();
+}
+
+// Expanding the range into the occurrence store the agenda models share
+void tst_CalendarBenchmark::expansion()
+{
+    QFETCH(int, days);
+
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    KDateTime::Spec spec(KDateTime::LocalZone);
+    QDate end = mStart.addDays(days);
+    NemoCalendarOccurrenceStore store;
+
+    QBENCHMARK {
+        store.assign(calendar->rawExpandedEvents(mStart, end, false, false, spec), mNotebooks);
+    }
+
+    QVERIFY(store.count() > 0);
+}
+
+void tst_CalendarBenchmark::upcoming_data()
+{
+    QTest::addColumn<int>("limit");
+
+    QTest::newRow("5") << 5;
+    QTest::newRow("50") << 50;
+}
+
+// The next occurrences across the calendar, as the upcoming model asks for
+// them while following the current time
+void tst_CalendarBenchmark::upcoming()
+{
+    QFETCH(int, limit);
+
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    NemoCalendarUpcomingIndex index;
+    index.sync(calendar);
+
+    KDateTime from = KDateTime::currentLocalDateTime();
+    mKCal::ExtendedCalendar::ExpandedIncidenceList occurrences;
+
+    QBENCHMARK {
+        from = from.addSecs(60);
+        occurrences = index.upcoming(from, limit, calendar, mNotebooks);
+    }
+
+    QCOMPARE(occurrences.count(), limit);
+}
+
+void tst_CalendarBenchmark::search_data()
+{
+    QTest::addColumn<QString>("query");
+
+    QTest::newRow("letter") << "m";
+    QTest::newRow("prefix") << "meet";
+    QTest::newRow("word") << "meeting";
+    QTest::newRow("infix") << "eeti";
+    QTest::newRow("two words") << "team meeting";
+}
+
+void tst_CalendarBenchmark::search()
+{
+    QFETCH(QString, query);
+
+    NemoCalendarSearchIndex index;
+    index.sync(NemoCalendarDb::calendar());
+
+    QList<NemoCalendarSearchIndex::Match> matches;
+    QBENCHMARK {
+        matches = index.search(query);
+    }
+
+    QVERIFY(!matches.isEmpty());
+}
+
+void tst_CalendarBenchmark::refine_data()
+{
+    QTest::addColumn<QString>("previous");
+    QTest::addColumn<QString>("query");
+
+    QTest::newRow("second letter") << "m" << "me";
+    QTest::newRow("longer prefix") << "meet" << "meeti";
+    QTest::newRow("second word") << "team" << "team meeting";
+}
+
+// The matches of a string typed one more character, refined from the
+// matches of the string before it.  The result must be what a full search
+// gives.
+void tst_CalendarBenchmark::refine()
+{
+    QFETCH(QString, previous);
+    QFETCH(QString, query);
+
+    NemoCalendarSearchIndex index;
+    index.sync(NemoCalendarDb::calendar());
+
+    QVERIFY(NemoCalendarSearchIndex::narrows(query, previous));
+    QList<NemoCalendarSearchIndex::Match> candidates = index.search(previous);
+
+    QList<NemoCalendarSearchIndex::Match> matches;
+    QBENCHMARK {
+        matches = index.refine(query, candidates);
+    }
+
+    QHash<QString, int> expected;
+    QList<NemoCalendarSearchIndex::Match> searched = index.search(query);
+    for (int ii = 0; ii < searched.count(); ++ii)
+        expected.insert(searched.at(ii).event->uid(), searched.at(ii).score);
+
+    QCOMPARE(matches.count(), expected.count());
+    for (int ii = 0; ii < matches.count(); ++ii)
+        QCOMPARE(matches.at(ii).score, expected.value(matches.at(ii).event->uid(), -1));
+}
+
+KCalCore::Event::List tst_CalendarBenchmark::sampleEvents(int count, bool recurring)
+{
+    KCalCore::Event::List events = NemoCalendarDb::calendar()->rawEvents();
+    KCalCore::Event::List rv;
+    for (int ii = 0; ii < events.count() && rv.count() < count; ++ii) {
+        if (events.at(ii)->recurs() == recurring && !events.at(ii)->hasRecurrenceId())
+            rv.append(events.at(ii));
+    }
+    return rv;
+}
+
+// Resolving occurrences of 100 recurring events, as event pages do
+void tst_CalendarBenchmark::eventQuery()
+{
+    KCalCore::Event::List recurring = sampleEvents(100, true);
+    QVERIFY(!recurring.isEmpty());
+
+    QBENCHMARK {
+        for (int ii = 0; ii < recurring.count(); ++ii) {
+            NemoCalendarEventQuery query;
+            query.classBegin();
+            query.setUniqueId(recurring.at(ii)->uid());
+            query.setStartTime(QDateTime(mStart.addDays(ii % 30), QTime(12, 0)));
+            query.componentComplete();
+        }
+    }
+}
+
+// An edit of a single event, and the reload and month agenda refresh that
+// follow it
+void tst_CalendarBenchmark::editRefresh()
+{
+    KCalCore::Event::List single = sampleEvents(100, false);
+    QVERIFY(!single.isEmpty());
+
+    NemoCalendarAgendaModel model;
+    model.setStartDate(mStart);
+    model.setEndDate(mStart.addDays(30));
+    SyntheticCalendar::drainRefresh();
+
+    int index = 0;
+    QBENCHMARK {
+        NemoCalendarEvent event(single.at(index++ % single.count()));
+        event.setDisplayLabel(event.displayLabel() + " edited");
+        event.save();
+        NemoCalendarEventCache::instance()->load();
+        SyntheticCalendar::drainRefresh();
+    }
+}
+
+void tst_CalendarBenchmark::saveSingle()
+{
+    KCalCore::Event::List single = sampleEvents(100, false);
+    QVERIFY(!single.isEmpty());
+
+    int index = 0;
+    QBENCHMARK {
+        NemoCalendarEvent event(single.at(index % single.count()));
+        event.setDescription(QString("saved %1").arg(index++));
+        event.save();
+    }
+}
+
+// Changes to 100 recurring events written in one save
+void tst_CalendarBenchmark::saveBatch()
+{
+    KCalCore::Event::List recurring = sampleEvents(100, true);
+    QVERIFY(!recurring.isEmpty());
+
+    int batch = 0;
+    QBENCHMARK {
+        for (int ii = 0; ii < recurring.count(); ++ii) {
+            recurring.at(ii)->setDescription(QString("batch %1").arg(batch));
+            recurring.at(ii)->setRevision(recurring.at(ii)->revision() + 1);
+        }
+        ++batch;
+        QVERIFY(NemoCalendarDb::save());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    // Started by initTestCase() to generate the database
+    if (!qgetenv("NEMO_CALENDAR_BENCH_GENERATE").isEmpty()) {
+        SyntheticCalendar calendar(tst_CalendarBenchmark::options());
+        return calendar.populate() ? 0 : 1;
+    }
+
+    tst_CalendarBenchmark test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_calendarbenchmark.moc"
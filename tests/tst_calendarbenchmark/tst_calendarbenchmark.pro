@@ -0,0 +1,5 @@
+TARGET = tst_calendarbenchmark
+
+include(../tests.pri)
+
+SOURCES += tst_calendarbenchmark.cpp
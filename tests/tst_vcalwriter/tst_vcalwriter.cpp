@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+// Checks that NemoCalendarVCalWriter writes byte for byte what VCalFormat
+// writes, over a corpus of hand made events and a synthetic calendar, and
+// times both on the share path.
+
+#include <QtTest>
+#include <QBitArray>
+#include <QTemporaryDir>
+
+// kcalcore
+#include <person.h>
+
+#include "calendardb.h"
+#include "calendarvcalwriter.h"
+#include "syntheticcalendar.h"
+
+static const char ProdId[] = "-//NemoMobile.org/Nemo//NONSGML v1.0//EN";
+
+class tst_VCalWriter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void conformance_data();
+    void conformance();
+    void synthetic();
+
+    void share_data();
+    void share();
+
+private:
+    QTemporaryDir mDirectory;
+    QDateTime mCreated;
+    QList<KCalCore::Event::Ptr> mCorpus;
+};
+
+static KCalCore::Event::Ptr timedEvent(const QString &uid, const KDateTime::Spec &spec = KDateTime::Spec::UTC())
+{
+    KCalCore::Event::Ptr event(new KCalCore::Event);
+    event->setUid(uid);
+    event->setCreated(KDateTime(QDate(2014, 1, 2), QTime(8, 0), KDateTime::Spec::UTC()));
+    event->setLastModified(KDateTime(QDate(2014, 1, 3), QTime(9, 30), KDateTime::Spec::UTC()));
+    event->setRevision(2);
+    event->setDtStart(KDateTime(QDate(2014, 3, 10), QTime(9, 0), spec));
+    event->setDtEnd(KDateTime(QDate(2014, 3, 10), QTime(10, 30), spec));
+    event->setSummary(QLatin1String("Team meeting"));
+    return event;
+}
+
+static KCalCore::Event::Ptr allDayEvent(const QString &uid, int days)
+{
+    KCalCore::Event::Ptr event = timedEvent(uid);
+    event->setDtStart(KDateTime(QDate(2014, 3, 10), KDateTime::Spec(KDateTime::LocalZone)));
+    event->setDtEnd(KDateTime(QDate(2014, 3, 10).addDays(days - 1), KDateTime::Spec(KDateTime::LocalZone)));
+    event->setAllDay(true);
+    return event;
+}
+
+void tst_VCalWriter::initTestCase()
+{
+    QVERIFY(mDirectory.isValid());
+    SyntheticCalendar::useDatabase(mDirectory.path() + "/db");
+
+    mCreated = QDateTime(QDate(2014, 6, 1), QTime(12, 0));
+
+    SyntheticCalendar::Options options;
+    options.seed = 7;
+    options.events = 500;
+    options.alarmRatio = 0.5;
+    SyntheticCalendar calendar(options);
+    QVERIFY(calendar.populate());
+}
+
+void tst_VCalWriter::conformance_data()
+{
+    QTest::addColumn<int>("index");
+    mCorpus.clear();
+
+    KCalCore::Event::Ptr event;
+
+#define ADD_EVENT(name) \
+    QTest::newRow(name) << mCorpus.count(); \
+    mCorpus.append(event);
+
+    event = timedEvent("timed");
+    event->setLocation(QLatin1String("Room 1"));
+    event->setDescription(QLatin1String("Agenda to follow"));
+    ADD_EVENT("timed");
+
+    event = timedEvent("local", KDateTime::Spec(KDateTime::LocalZone));
+    ADD_EVENT("local zone");
+
+    event = timedEvent("clock", KDateTime::Spec(KDateTime::ClockTime));
+    ADD_EVENT("clock time");
+
+    event = timedEvent("no end");
+    event->setDtEnd(event->dtStart());
+    ADD_EVENT("no end");
+
+    event = allDayEvent("all day", 1);
+    ADD_EVENT("all day");
+
+    event = allDayEvent("all day span", 3);
+    ADD_EVENT("all day span");
+
+    event = timedEvent("daily");
+    event->recurrence()->setDaily(2);
+    event->recurrence()->setDuration(10);
+    ADD_EVENT("daily count");
+
+    {
+        QBitArray days(7);
+        days.setBit(0);
+        days.setBit(2);
+        days.setBit(4);
+        event = timedEvent("weekly");
+        event->recurrence()->setWeekly(2, days);
+        event->recurrence()->setEndDate(QDate(2014, 12, 31));
+        ADD_EVENT("weekly until");
+    }
+
+    event = timedEvent("monthly");
+    event->recurrence()->setMonthly(1);
+    event->recurrence()->addMonthlyDate(10);
+    ADD_EVENT("monthly day");
+
+    event = allDayEvent("yearly", 1);
+    event->recurrence()->setYearly(1);
+    event->recurrence()->addYearlyMonth(3);
+    ADD_EVENT("yearly month");
+
+    event = timedEvent("exdatetimes");
+    event->recurrence()->setDaily(1);
+    event->recurrence()->addExDateTime(KDateTime(QDate(2014, 3, 12), QTime(9, 0), KDateTime::Spec::UTC()));
+    event->recurrence()->addExDateTime(KDateTime(QDate(2014, 3, 15), QTime(9, 0), KDateTime::Spec::UTC()));
+    ADD_EVENT("exception times");
+
+    event = allDayEvent("exdates", 1);
+    event->recurrence()->setWeekly(1);
+    event->recurrence()->addExDate(QDate(2014, 3, 17));
+    event->recurrence()->addExDate(QDate(2014, 3, 31));
+    ADD_EVENT("exception dates");
+
+    event = timedEvent("utf-8");
+    event->setSummary(QString::fromUtf8("Caf\xc3\xa9 \xc3\xbcber \xe2\x98\x95"));
+    event->setLocation(QString::fromUtf8("M\xc3\xbcnchen"));
+    event->setDescription(QString::fromUtf8("Line one\nLine two ends in a space \nx = y\t\nDone"));
+    ADD_EVENT("utf-8 text");
+
+    event = timedEvent("long");
+    event->setDescription(QString(QLatin1String("A long line of plain text to be folded. ")).repeated(8));
+    ADD_EVENT("long text");
+
+    event = timedEvent("long encoded");
+    event->setDescription(QString::fromUtf8("\xc3\xa4\xc3\xb6 = \xc3\xbc ").repeated(30));
+    ADD_EVENT("long encoded text");
+
+    event = timedEvent("reminder");
+    {
+        // As NemoCalendarEvent::setReminder() adds it
+        KCalCore::Alarm::Ptr alarm = event->newAlarm();
+        alarm->setEnabled(true);
+        alarm->setStartOffset(KCalCore::Duration(-15 * 60));
+    }
+    ADD_EVENT("reminder");
+
+    event = timedEvent("display alarm");
+    {
+        KCalCore::Alarm::Ptr alarm = event->newAlarm();
+        alarm->setDisplayAlarm(QLatin1String("Leave now"));
+        alarm->setEnabled(true);
+        alarm->setStartOffset(KCalCore::Duration(-30 * 60));
+
+        alarm = event->newAlarm();
+        alarm->setDisplayAlarm(QString());
+        alarm->setEnabled(false);
+        alarm->setStartOffset(KCalCore::Duration(-60 * 60));
+    }
+    ADD_EVENT("display alarms");
+
+    event = timedEvent("details");
+    event->setOrganizer(KCalCore::Person::Ptr(new KCalCore::Person(QLatin1String("Organizer"),
+                                                                   QLatin1String("organizer@example.com"))));
+    event->setCategories(QStringList() << QLatin1String("Work") << QLatin1String("Travel"));
+    event->setPriority(3);
+    event->setTransparency(KCalCore::Event::Transparent);
+    event->setSecrecy(KCalCore::Incidence::SecrecyPrivate);
+    ADD_EVENT("organizer and classes");
+
+#undef ADD_EVENT
+}
+
+void tst_VCalWriter::conformance()
+{
+    QFETCH(int, index);
+
+    const KCalCore::Event::Ptr &event = mCorpus.at(index);
+    QVERIFY(NemoCalendarVCalWriter::canWrite(event));
+
+    QByteArray reference = NemoCalendarVCalWriter::referenceVCalendar(event, QLatin1String(ProdId), mCreated);
+    QCOMPARE(NemoCalendarVCalWriter::vCalendar(event, QLatin1String(ProdId), mCreated), reference);
+}
+
+// Every event of a synthetic calendar the writer accepts
+void tst_VCalWriter::synthetic()
+{
+    KCalCore::Event::List events = NemoCalendarDb::calendar()->rawEvents();
+    int written = 0;
+    for (int ii = 0; ii < events.count(); ++ii) {
+        const KCalCore::Event::Ptr &event = events.at(ii);
+        if (!NemoCalendarVCalWriter::canWrite(event))
+            continue;
+
+        QByteArray reference = NemoCalendarVCalWriter::referenceVCalendar(event, QLatin1String(ProdId), mCreated);
+        QByteArray direct = NemoCalendarVCalWriter::vCalendar(event, QLatin1String(ProdId), mCreated);
+        if (direct != reference) {
+            QFAIL(qPrintable(QString("Output differs for %1:\n%2\n---\n%3").arg(event->uid())
+                             .arg(QString::fromUtf8(reference)).arg(QString::fromUtf8(direct))));
+        }
+        ++written;
+    }
+
+    QVERIFY(written > 0);
+}
+
+void tst_VCalWriter::share_data()
+{
+    QTest::addColumn<bool>("reference");
+
+    QTest::newRow("direct writer") << false;
+    QTest::newRow("VCalFormat") << true;
+}
+
+// Writing the events of the synthetic calendar as sharing them does
+void tst_VCalWriter::share()
+{
+    QFETCH(bool, reference);
+
+    KCalCore::Event::List events = NemoCalendarDb::calendar()->rawEvents();
+    QVERIFY(!events.isEmpty());
+
+    QString prodId = QLatin1String(ProdId);
+    int size = 0;
+    QBENCHMARK {
+        size = 0;
+        for (int ii = 0; ii < events.count(); ++ii) {
+            if (reference || !NemoCalendarVCalWriter::canWrite(events.at(ii)))
+                size += NemoCalendarVCalWriter::referenceVCalendar(events.at(ii), prodId, mCreated).size();
+            else
+                size += NemoCalendarVCalWriter::vCalendar(events.at(ii), prodId, mCreated).size();
+        }
+    }
+
+    QVERIFY(size > 0);
+}
+
+QTEST_GUILESS_MAIN(tst_VCalWriter)
+
+#include "tst_vcalwriter.moc"
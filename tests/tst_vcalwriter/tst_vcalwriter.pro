@@ -0,0 +1,5 @@
+TARGET = tst_vcalwriter
+
+include(../tests.pri)
+
+SOURCES += tst_vcalwriter.cpp
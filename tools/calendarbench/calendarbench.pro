@@ -0,0 +1,5 @@
+TARGET = nemocalendar-bench
+
+include(../tools.pri)
+
+SOURCES += main.cpp
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+// Times startup to the first agenda week against a synthetic calendar
+// database, served from the snapshot if an earlier run left one.  Run it
+// twice on the same --database to compare a cold start with a warm one.
+// Each run needs a fresh process, which is why this is not part of the
+// tst_calendarbenchmark suite that covers the rest of the engine.
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QFile>
+#include <QProcess>
+
+#include "calendareventcache.h"
+#include "calendaragendamodel.h"
+#include "syntheticcalendar.h"
+
+static QTextStream out(stdout);
+
+static void usage()
+{
+    out << "Usage: nemocalendar-bench [options]\n"
+           "  --database FILE   database to use, generated if it does not exist\n"
+           "                    (default: a temporary database)\n"
+           "Options for generating the database:\n"
+        << SyntheticCalendar::optionsUsage();
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    SyntheticCalendar::Options options;
+    QString database;
+    bool generateOnly = false;
+
+    QStringList args = app.arguments();
+    for (int ii = 1; ii < args.count(); ++ii) {
+        const QString &arg = args.at(ii);
+        if (SyntheticCalendar::parseOption(args, ii, options)) {
+            continue;
+        } else if (ii + 1 < args.count() && arg == "--database") {
+            database = args.at(++ii);
+        } else if (arg == "--generate-only") {
+            generateOnly = true;
+        } else {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    QTemporaryDir temporary;
+    if (database.isEmpty())
+        database = temporary.path() + "/db";
+
+    SyntheticCalendar::useDatabase(database);
+
+    if (generateOnly) {
+        SyntheticCalendar calendar(options);
+        return calendar.populate() ? 0 : 1;
+    }
+
+    if (!QFile::exists(database)) {
+        // Generate in a separate process so that startup is measured from
+        // storage rather than from what the generator left in memory
+        out << "Generating " << options.events << " events in " << database << "\n" << flush;
+        QStringList generateArgs = args.mid(1);
+        generateArgs << "--database" << database << "--generate-only";
+        if (QProcess::execute(app.applicationFilePath(), generateArgs) != 0) {
+            out << "Cannot populate " << database << "\n";
+            return 1;
+        }
+    }
+
+    QDate today = QDate::currentDate();
+
+    QElapsedTimer timer;
+    timer.start();
+    NemoCalendarAgendaModel model;
+    model.setStartDate(today);
+    model.setEndDate(today.addDays(6));
+    SyntheticCalendar::drainRefresh();
+    out << "startup to agenda week: " << fixed << qSetRealNumberPrecision(2)
+        << timer.nsecsElapsed() / 1000000. << " ms\n" << flush;
+
+    // Leave a snapshot for the next run
+    NemoCalendarEventCache::instance()->ensureLoaded();
+    QMetaObject::invokeMethod(NemoCalendarEventCache::instance(), "writeSnapshot");
+
+    return 0;
+}
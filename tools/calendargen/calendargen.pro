@@ -0,0 +1,5 @@
+TARGET = nemocalendar-gen
+
+include(../tools.pri)
+
+SOURCES += main.cpp
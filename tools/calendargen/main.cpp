@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+// Fills a calendar database with synthetic events.  The same options give
+// the same database on every machine, provided the time zone matches, so
+// it can be used to reproduce reports against calendars of a given shape.
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QFile>
+
+#include "syntheticcalendar.h"
+
+static void usage(QTextStream &out)
+{
+    out << "Usage: nemocalendar-gen --database FILE [options]\n"
+           "       nemocalendar-gen --default-database [options]\n"
+           "  --database FILE     database to create\n"
+           "  --default-database  add to the user's calendar database instead\n"
+           "  --quiet             do not report progress\n"
+        << SyntheticCalendar::optionsUsage();
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QTextStream out(stdout);
+
+    SyntheticCalendar::Options options;
+    QString database;
+    bool defaultDatabase = false;
+    bool quiet = false;
+
+    QStringList args = app.arguments();
+    for (int ii = 1; ii < args.count(); ++ii) {
+        const QString &arg = args.at(ii);
+        if (SyntheticCalendar::parseOption(args, ii, options)) {
+            continue;
+        } else if (ii + 1 < args.count() && arg == "--database") {
+            database = args.at(++ii);
+        } else if (arg == "--default-database") {
+            defaultDatabase = true;
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else {
+            usage(out);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (database.isEmpty() == !defaultDatabase) {
+        usage(out);
+        return 1;
+    }
+
+    if (!database.isEmpty()) {
+        if (QFile::exists(database)) {
+            out << database << " already exists\n";
+            return 1;
+        }
+        SyntheticCalendar::useDatabase(database);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    SyntheticCalendar calendar(options);
+    if (!calendar.populate(quiet ? 0 : &out)) {
+        out << "Cannot populate the calendar database\n";
+        return 1;
+    }
+
+    if (!quiet)
+        out << "Generated " << options.events << " events in " << timer.elapsed() << " ms\n";
+
+    return 0;
+}
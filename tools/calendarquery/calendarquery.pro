@@ -0,0 +1,10 @@
+TARGET = nemocalendar-query
+
+include(../tools.pri)
+
+SOURCES += \
+    main.cpp \
+    $$SRC_DIR/calendarsearchmodel.cpp \
+
+HEADERS += \
+    $$SRC_DIR/calendarsearchmodel.h \
@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+// Runs scripted operations against the plugin's engine without a QML
+// engine, printing how long each took.  Useful for running perf, heaptrack
+// or callgrind on the cache and models directly.
+//
+// Commands, one per line or given with -c:
+//
+//   load                       reload the event cache
+//   agenda FROM..TO            open an agenda model on the date range
+//   close                      close all open agenda models
+//   edit UID [SUMMARY]         change the summary of an event and save it
+//   query UID [TIME]           resolve an occurrence as EventQuery does
+//   search TERM...             run a search to completion
+//   repeat N COMMAND...        run a command N times
+//   replay FILE [-v]           replay inputs recorded with NEMO_CALENDAR_RECORD,
+//                              reporting the latency of each
+//   stats                      print the counters of NEMO_CALENDAR_TRACE
+//   wait MS                    run the event loop, e.g. for deferred loads
+//                              and the shared index to be published
+//
+// Agenda models stay open until closed, so edits and reloads refresh them.
+//
+// With NEMO_CALENDAR_SHARED=1, one instance left waiting publishes the
+// occurrence index and others started meanwhile serve agendas from it
+// without loading the storage, e.g.
+//
+//   nemocalendar-query --database db -c "wait 60000" &
+//   nemocalendar-query --database db -c "agenda 2026-10-19..2026-10-25" -c stats
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+#include <QFile>
+#include <QTimer>
+#include <QEventLoop>
+
+#include "calendardb.h"
+#include "calendarevent.h"
+#include "calendareventcache.h"
+#include "calendaragendamodel.h"
+#include "calendareventquery.h"
+#include "calendarsearchmodel.h"
+#include "calendarstats.h"
+#include "syntheticcalendar.h"
+
+static QTextStream out(stdout);
+
+class QueryRunner
+{
+public:
+    ~QueryRunner() { qDeleteAll(mAgendas); }
+
+    bool run(const QString &line);
+
+private:
+    // An input being replayed, waiting for the refresh that follows it
+    struct PendingInput {
+        int line;
+        QString kind;
+        qint64 applied;
+    };
+
+    bool execute(const QStringList &command);
+
+    bool replay(const QString &fileName, bool verbose);
+
+    QList<NemoCalendarAgendaModel *> mAgendas;
+};
+
+static QString formatTime(qint64 nsecs)
+{
+    return QString::number(nsecs / 1000000., 'f', 2) + " ms";
+}
+
+bool QueryRunner::run(const QString &line)
+{
+    QString trimmed = line.trimmed();
+    if (trimmed.isEmpty() || trimmed.startsWith(QLatin1Char('#')))
+        return true;
+
+    QStringList command = trimmed.split(QLatin1Char(' '), QString::SkipEmptyParts);
+
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = execute(command);
+    out << "  " << formatTime(timer.nsecsElapsed()) << "\n" << flush;
+
+    return ok;
+}
+
+bool QueryRunner::execute(const QStringList &command)
+{
+    const QString &name = command.first();
+    out << command.join(QLatin1String(" ")) << ": ";
+
+    if (name == "load" && command.count() == 1) {
+        NemoCalendarEventCache::instance()->load();
+        SyntheticCalendar::drainRefresh();
+        out << "ok";
+    } else if (name == "agenda" && command.count() == 2) {
+        QStringList range = command.at(1).split(QLatin1String(".."));
+        QDate start = QDate::fromString(range.first(), Qt::ISODate);
+        QDate end = range.count() == 2 ? QDate::fromString(range.last(), Qt::ISODate) : start;
+        if (!start.isValid() || !end.isValid()) {
+            out << "invalid range";
+            return false;
+        }
+
+        NemoCalendarAgendaModel *model = new NemoCalendarAgendaModel;
+        model->setStartDate(start);
+        model->setEndDate(end);
+        SyntheticCalendar::drainRefresh();
+        mAgendas.append(model);
+        out << model->count() << " occurrences";
+    } else if (name == "close" && command.count() == 1) {
+        qDeleteAll(mAgendas);
+        mAgendas.clear();
+        out << "ok";
+    } else if (name == "edit" && command.count() >= 2) {
+        KCalCore::Event::Ptr incidence = NemoCalendarDb::calendar()->event(command.at(1));
+        if (!incidence) {
+            out << "no such event";
+            return false;
+        }
+
+        NemoCalendarEvent event(incidence);
+        QString summary = command.mid(2).join(QLatin1String(" "));
+        event.setDisplayLabel(summary.isEmpty() ? event.displayLabel() + " edited" : summary);
+        event.save();
+        NemoCalendarEventCache::instance()->load();
+        SyntheticCalendar::drainRefresh();
+        out << "saved";
+    } else if (name == "query" && (command.count() == 2 || command.count() == 3)) {
+        NemoCalendarEventQuery query;
+        query.classBegin();
+        query.setUniqueId(command.at(1));
+        if (command.count() == 3)
+            query.setStartTime(QDateTime::fromString(command.at(2), Qt::ISODate));
+        query.componentComplete();
+
+        NemoCalendarEventOccurrence *occurrence = qobject_cast<NemoCalendarEventOccurrence *>(query.occurrence());
+        if (!occurrence) {
+            out << "no occurrence";
+            return false;
+        }
+        out << occurrence->startTime().toString(Qt::ISODate) << " - "
+            << occurrence->endTime().toString(Qt::ISODate);
+    } else if (name == "search" && command.count() >= 2) {
+        NemoCalendarSearchModel model;
+        model.classBegin();
+        model.setSearchString(command.mid(1).join(QLatin1String(" ")));
+        model.componentComplete();
+
+        // Results are added in time-boxed chunks from the event loop
+        int count;
+        do {
+            count = model.count();
+            QCoreApplication::sendPostedEvents(&model, QEvent::User);
+        } while (model.count() != count);
+        out << model.count() << " results";
+    } else if (name == "repeat" && command.count() >= 3) {
+        int times = command.at(1).toInt();
+        for (int ii = 0; ii < times; ++ii) {
+            out << "\n    ";
+            if (!execute(command.mid(2)))
+                return false;
+        }
+    } else if (name == "replay" && (command.count() == 2 || (command.count() == 3 && command.at(2) == "-v"))) {
+        return replay(command.at(1), command.count() == 3);
+    } else if (name == "wait" && command.count() == 2) {
+        QEventLoop loop;
+        QTimer::singleShot(qMax(0, command.at(1).toInt()), &loop, SLOT(quit()));
+        loop.exec();
+        out << NemoCalendarDb::calendar()->rawEvents().count() << " events loaded";
+    } else if (name == "stats" && command.count() == 1) {
+        NemoCalendarStats *stats = NemoCalendarStats::instance();
+        out << stats->liveEvents() << " events, " << stats->liveOccurrences() << " occurrences ("
+            << stats->orphanedOccurrences() << " orphaned), " << stats->loadedIncidences() << " incidences, ~"
+            << qint64(stats->incidenceBytes()) / 1024 << " KiB";
+
+        QVariantList models = stats->models();
+        for (int ii = 0; ii < models.count(); ++ii) {
+            QVariantMap model = models.at(ii).toMap();
+            out << "\n    " << model.value("type").toString() << " " << model.value("occurrences").toInt()
+                << " occurrences, " << model.value("events").toInt() << " events, ~"
+                << qint64(model.value("estimatedBytes").toDouble()) / 1024 << " KiB";
+        }
+
+        if (!stats->enabled()) {
+            out << "\n    set NEMO_CALENDAR_TRACE to record stages and counters";
+            return true;
+        }
+
+        QVariantMap counters = stats->counters();
+        for (QVariantMap::ConstIterator iter = counters.begin(); iter != counters.end(); ++iter)
+            out << "\n    " << iter.key() << " " << iter.value().toInt();
+
+        QVariantMap stages = stats->stages();
+        for (QVariantMap::ConstIterator iter = stages.begin(); iter != stages.end(); ++iter) {
+            QVariantMap stage = iter.value().toMap();
+            out << "\n    " << iter.key() << " " << stage.value("count").toInt() << " runs, "
+                << stage.value("total").toDouble() << " ms total, "
+                << stage.value("max").toDouble() << " ms max";
+        }
+    } else {
+        out << "unknown command";
+        return false;
+    }
+
+    return true;
+}
+
+// Feeds recorded inputs to the cache and to agenda models standing in for
+// the recorded ones.  Agenda refreshes run where they ran when recording,
+// so inputs are coalesced the same way.  The latency of an input is the
+// time from applying it until the refresh that follows it completes.
+bool QueryRunner::replay(const QString &fileName, bool verbose)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        out << "cannot open " << fileName;
+        return false;
+    }
+
+    QHash<int, NemoCalendarAgendaModel *> models;
+    QList<PendingInput> pending;
+    QList<double> latencies;
+    QElapsedTimer clock;
+    clock.start();
+
+    QTextStream in(&file);
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && !in.atEnd()) {
+        QStringList fields = in.readLine().split(QLatin1Char('\t'));
+        ++lineNumber;
+        if (fields.count() < 2)
+            continue;
+
+        const QString &kind = fields.at(1);
+        PendingInput input = { lineNumber, kind, clock.nsecsElapsed() };
+
+        if (kind == "storageModified") {
+            NemoCalendarEventCache::instance()->storageModified(NemoCalendarDb::storage().data(), fields.value(2));
+            pending.append(input);
+        } else if (kind == "agenda" && fields.count() == 5) {
+            int id = fields.at(2).toInt();
+            NemoCalendarAgendaModel *model = models.value(id);
+            if (!model) {
+                model = new NemoCalendarAgendaModel;
+                models.insert(id, model);
+            }
+            model->setStartDate(QDate::fromString(fields.at(3), Qt::ISODate));
+            model->setEndDate(QDate::fromString(fields.at(4), Qt::ISODate));
+            pending.append(input);
+        } else if (kind == "agendaDestroyed" && fields.count() == 3) {
+            delete models.take(fields.at(2).toInt());
+        } else if (kind == "refresh") {
+            SyntheticCalendar::drainRefresh();
+            qint64 now = clock.nsecsElapsed();
+            for (int ii = 0; ii < pending.count(); ++ii) {
+                double latency = (now - pending.at(ii).applied) / 1000000.;
+                latencies.append(latency);
+                if (verbose)
+                    out << "\n    line " << pending.at(ii).line << " " << pending.at(ii).kind << " "
+                        << QString::number(latency, 'f', 2) << " ms";
+            }
+            pending.clear();
+        } else {
+            out << "\n    line " << lineNumber << ": cannot replay " << kind;
+            ok = false;
+        }
+    }
+
+    SyntheticCalendar::drainRefresh();
+    qDeleteAll(models);
+
+    if (latencies.isEmpty()) {
+        out << "\n    no refreshed inputs";
+        return ok;
+    }
+
+    qSort(latencies);
+    out << "\n    " << latencies.count() << " inputs, latency median "
+        << QString::number(latencies.at(latencies.count() / 2), 'f', 2) << " ms, 95% "
+        << QString::number(latencies.at(latencies.count() * 95 / 100), 'f', 2) << " ms, max "
+        << QString::number(latencies.last(), 'f', 2) << " ms";
+    return ok;
+}
+
+static void usage()
+{
+    out << "Usage: nemocalendar-query [--database FILE] [-c COMMAND]... [SCRIPT]...\n"
+           "Runs commands given with -c, then the scripts, or reads commands from\n"
+           "standard input if neither is given.  See the source for the commands.\n"
+           "  --database FILE   calendar database to open (default: the user's)\n"
+           "  --keep-going      continue after a failed command\n";
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QStringList commands;
+    QStringList scripts;
+    bool keepGoing = false;
+
+    QStringList args = app.arguments();
+    for (int ii = 1; ii < args.count(); ++ii) {
+        const QString &arg = args.at(ii);
+        if (ii + 1 < args.count() && arg == "--database") {
+            qputenv("SQLITESTORAGEDB", args.at(++ii).toLocal8Bit());
+        } else if (ii + 1 < args.count() && arg == "-c") {
+            commands.append(args.at(++ii));
+        } else if (arg == "--keep-going") {
+            keepGoing = true;
+        } else if (!arg.startsWith(QLatin1Char('-'))) {
+            scripts.append(arg);
+        } else {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    NemoCalendarEventCache::instance();
+    out << "open: " << NemoCalendarDb::calendar()->rawEvents().count() << " events\n  "
+        << formatTime(timer.nsecsElapsed()) << "\n" << flush;
+
+    QueryRunner runner;
+
+    for (int ii = 0; ii < commands.count(); ++ii) {
+        if (!runner.run(commands.at(ii)) && !keepGoing)
+            return 1;
+    }
+
+    for (int ii = 0; ii < scripts.count(); ++ii) {
+        QFile file(scripts.at(ii));
+        if (!file.open(QIODevice::ReadOnly)) {
+            out << "Cannot open " << scripts.at(ii) << "\n";
+            return 1;
+        }
+
+        QTextStream script(&file);
+        while (!script.atEnd()) {
+            if (!runner.run(script.readLine()) && !keepGoing)
+                return 1;
+        }
+    }
+
+    if (commands.isEmpty() && scripts.isEmpty()) {
+        QTextStream in(stdin);
+        while (!in.atEnd()) {
+            if (!runner.run(in.readLine()) && !keepGoing)
+                return 1;
+        }
+    }
+
+    return 0;
+}
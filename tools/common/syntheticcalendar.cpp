@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "syntheticcalendar.h"
+
+#include <QBitArray>
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+// mkcal
+#include <notebook.h>
+
+#include "calendardb.h"
+#include "calendareventcache.h"
+
+// Events added between storage saves
+static const int SaveInterval = 1000;
+
+static const char *vocabulary[] = {
+    "meeting", "review", "lunch", "project", "team", "weekly", "planning", "call",
+    "dentist", "gym", "birthday", "dinner", "sync", "release", "design", "budget",
+    "school", "concert", "trip", "training", "interview", "standup", "demo", "party",
+    "office", "library", "football", "yoga", "doctor", "workshop", "retro", "report"
+};
+static const int vocabularySize = sizeof(vocabulary) / sizeof(vocabulary[0]);
+
+SyntheticCalendar::Options::Options()
+: seed(1), notebooks(1), events(1000), recurringRatio(0.2), complexRatio(0.3), exceptionDensity(2.0),
+  allDayRatio(0.1), alarmRatio(0.3), descriptionSize(100), startDate(2014, 1, 1), days(365)
+{
+}
+
+SyntheticCalendar::SyntheticCalendar(const Options &options)
+: mOptions(options), mState(options.seed ? options.seed : 0x9e3779b9)
+{
+    // Mix the seed so that neighbouring seeds give unrelated sequences
+    for (int ii = 0; ii < 8; ++ii)
+        next();
+}
+
+bool SyntheticCalendar::parseOption(const QStringList &args, int &index, Options &options)
+{
+    if (index + 1 >= args.count())
+        return false;
+
+    const QString &arg = args.at(index);
+    const QString &value = args.at(index + 1);
+    bool ok = false;
+
+    if (arg == "--seed") {
+        options.seed = value.toUInt(&ok);
+    } else if (arg == "--notebooks") {
+        options.notebooks = value.toInt(&ok);
+    } else if (arg == "--events") {
+        options.events = value.toInt(&ok);
+    } else if (arg == "--recurring") {
+        options.recurringRatio = value.toDouble(&ok);
+    } else if (arg == "--complex") {
+        options.complexRatio = value.toDouble(&ok);
+    } else if (arg == "--exceptions") {
+        options.exceptionDensity = value.toDouble(&ok);
+    } else if (arg == "--all-day") {
+        options.allDayRatio = value.toDouble(&ok);
+    } else if (arg == "--alarms") {
+        options.alarmRatio = value.toDouble(&ok);
+    } else if (arg == "--description") {
+        options.descriptionSize = value.toInt(&ok);
+    } else if (arg == "--start") {
+        options.startDate = QDate::fromString(value, Qt::ISODate);
+        ok = options.startDate.isValid();
+    } else if (arg == "--days") {
+        options.days = value.toInt(&ok);
+    }
+
+    if (ok)
+        index += 1;
+    return ok;
+}
+
+QString SyntheticCalendar::optionsUsage()
+{
+    Options defaults;
+    return QString("  --seed N          generator seed (default %1)\n"
+                   "  --notebooks N     number of notebooks (default %2)\n"
+                   "  --events N        number of events (default %3)\n"
+                   "  --recurring R     fraction of events that recur (default %4)\n"
+                   "  --complex R       fraction of recurring events with complex rules (default %5)\n"
+                   "  --exceptions R    average exception dates per recurring event (default %6)\n"
+                   "  --all-day R       fraction of all-day events (default %7)\n"
+                   "  --alarms R        fraction of events with a reminder (default %8)\n"
+                   "  --description N   characters of description per event (default %9)\n"
+                   "  --start DATE      first day of the generated range (default %10)\n"
+                   "  --days N          length of the generated range (default %11)\n")
+            .arg(defaults.seed).arg(defaults.notebooks).arg(defaults.events)
+            .arg(defaults.recurringRatio).arg(defaults.complexRatio).arg(defaults.exceptionDensity)
+            .arg(defaults.allDayRatio).arg(defaults.alarmRatio).arg(defaults.descriptionSize)
+            .arg(defaults.startDate.toString(Qt::ISODate)).arg(defaults.days);
+}
+
+void SyntheticCalendar::useDatabase(const QString &fileName)
+{
+    qputenv("SQLITESTORAGEDB", fileName.toLocal8Bit());
+}
+
+void SyntheticCalendar::drainRefresh()
+{
+    QCoreApplication::sendPostedEvents(NemoCalendarEventCache::instance(), QEvent::User);
+}
+
+bool SyntheticCalendar::populate(QTextStream *progress)
+{
+    mKCal::ExtendedCalendar::Ptr calendar = NemoCalendarDb::calendar();
+    mKCal::ExtendedStorage::Ptr storage = NemoCalendarDb::storage();
+
+    QStringList notebooks;
+    for (int ii = 0; ii < qMax(1, mOptions.notebooks); ++ii) {
+        QString uid = QString("synthetic-notebook-%1-%2").arg(mOptions.seed).arg(ii);
+        mKCal::Notebook::Ptr notebook(new mKCal::Notebook(uid, QString("Synthetic %1.%2").arg(mOptions.seed).arg(ii),
+                                                          QString(), QString(), false, true, false, false, true,
+                                                          QString(), QString(), 0));
+        // The plugin saves new events to the default notebook
+        bool added = ii == 0 ? storage->setDefaultNotebook(notebook) : storage->addNotebook(notebook);
+        if (!added)
+            return false;
+        notebooks.append(uid);
+    }
+
+    for (int ii = 0; ii < mOptions.events; ++ii) {
+        KCalCore::Event::Ptr event = createEvent(ii);
+        calendar->addEvent(event, notebooks.at(bounded(notebooks.count())));
+
+        if ((ii + 1) % SaveInterval == 0 || ii + 1 == mOptions.events) {
+            if (!NemoCalendarDb::save())
+                return false;
+            if (progress)
+                *progress << ii + 1 << "/" << mOptions.events << " events\n" << flush;
+        }
+    }
+
+    return true;
+}
+
+// xorshift32, which is fast and identical everywhere unlike qrand()
+quint32 SyntheticCalendar::next()
+{
+    mState ^= mState << 13;
+    mState ^= mState >> 17;
+    mState ^= mState << 5;
+    return mState;
+}
+
+int SyntheticCalendar::bounded(int n)
+{
+    return n > 0 ? int(next() % quint32(n)) : 0;
+}
+
+bool SyntheticCalendar::chance(double p)
+{
+    return next() < p * 4294967296.0;
+}
+
+QString SyntheticCalendar::words(int minimum, int maximum)
+{
+    int count = minimum + bounded(maximum - minimum + 1);
+    QStringList rv;
+    for (int ii = 0; ii < count; ++ii)
+        rv.append(QLatin1String(vocabulary[bounded(vocabularySize)]));
+    return rv.join(QLatin1String(" "));
+}
+
+// Returns about size characters of words
+QString SyntheticCalendar::text(int size)
+{
+    QString rv;
+    while (rv.length() < size) {
+        if (!rv.isEmpty())
+            rv.append(QLatin1Char(rv.length() % 7 == 0 ? '\n' : ' '));
+        rv.append(QLatin1String(vocabulary[bounded(vocabularySize)]));
+    }
+    return rv.left(size);
+}
+
+KCalCore::Event::Ptr SyntheticCalendar::createEvent(int index)
+{
+    KCalCore::Event::Ptr event(new KCalCore::Event);
+    event->setUid(QString("synthetic-%1-%2").arg(mOptions.seed).arg(index));
+    event->setCreated(KDateTime(QDate(2014, 1, 1), QTime(0, 0), KDateTime::UTC));
+
+    QString summary = words(1, 3);
+    summary[0] = summary.at(0).toUpper();
+    event->setSummary(summary);
+    if (chance(0.5))
+        event->setLocation(words(1, 2));
+
+    if (mOptions.descriptionSize > 0)
+        event->setDescription(text(mOptions.descriptionSize));
+
+    setTimes(event);
+
+    if (chance(mOptions.recurringRatio)) {
+        addRecurrence(event);
+        addExceptions(event);
+    }
+
+    if (chance(mOptions.alarmRatio))
+        addAlarm(event);
+
+    return event;
+}
+
+void SyntheticCalendar::setTimes(const KCalCore::Event::Ptr &event)
+{
+    QDate date = mOptions.startDate.addDays(bounded(mOptions.days));
+
+    if (chance(mOptions.allDayRatio)) {
+        // All-day events end on their last day
+        event->setDtStart(KDateTime(date, KDateTime::Spec(KDateTime::LocalZone)));
+        event->setDtEnd(KDateTime(date.addDays(bounded(3)), KDateTime::Spec(KDateTime::LocalZone)));
+        event->setAllDay(true);
+        return;
+    }
+
+    KDateTime start(date, QTime(7, 0).addSecs(bounded(48) * 15 * 60), KDateTime::Spec(KDateTime::LocalZone));
+    event->setDtStart(start);
+    event->setDtEnd(start.addSecs((1 + bounded(8)) * 15 * 60));
+}
+
+// Adds a reminder the way NemoCalendarEvent::setReminder() does
+void SyntheticCalendar::addAlarm(const KCalCore::Event::Ptr &event)
+{
+    static const int offsets[] = { 0, 5, 15, 30, 60, 2 * 60, 24 * 60, 2 * 24 * 60 };
+
+    KCalCore::Alarm::Ptr alarm = event->newAlarm();
+    alarm->setEnabled(true);
+    alarm->setStartOffset(KCalCore::Duration(offsets[bounded(sizeof(offsets) / sizeof(offsets[0]))] * 60));
+}
+
+void SyntheticCalendar::addRecurrence(const KCalCore::Event::Ptr &event)
+{
+    KCalCore::Recurrence *recurrence = event->recurrence();
+
+    if (!chance(mOptions.complexRatio)) {
+        // The rules the plugin's recur property can express
+        switch (bounded(5)) {
+        case 0:
+            recurrence->setDaily(1);
+            break;
+        case 1:
+            recurrence->setWeekly(1);
+            break;
+        case 2:
+            recurrence->setWeekly(2);
+            break;
+        case 3:
+            recurrence->setMonthly(1);
+            break;
+        default:
+            recurrence->setYearly(1);
+            break;
+        }
+        return;
+    }
+
+    QBitArray days(7);
+    switch (bounded(4)) {
+    case 0:
+        // Several weekdays every week
+        for (int ii = 0; ii < 2 + bounded(3); ++ii)
+            days.setBit(bounded(5));
+        recurrence->setWeekly(1, days);
+        break;
+    case 1:
+        // e.g. the second Tuesday of every month
+        days.setBit(bounded(7));
+        recurrence->setMonthly(1);
+        recurrence->addMonthlyPos(1 + bounded(4), days);
+        break;
+    case 2:
+        // Every few days, a fixed number of times
+        recurrence->setDaily(2 + bounded(5));
+        recurrence->setDuration(10 + bounded(200));
+        break;
+    default:
+        // Weekly until an end date
+        recurrence->setWeekly(1 + bounded(3));
+        recurrence->setEndDate(event->dtStart().date().addDays(30 + bounded(700)));
+        break;
+    }
+}
+
+void SyntheticCalendar::addExceptions(const KCalCore::Event::Ptr &event)
+{
+    int count = int(mOptions.exceptionDensity);
+    if (chance(mOptions.exceptionDensity - count))
+        ++count;
+
+    KCalCore::Recurrence *recurrence = event->recurrence();
+    KDateTime occurrence = event->dtStart();
+    for (int ii = 0; ii < count; ++ii) {
+        for (int skip = bounded(8); skip >= 0 && occurrence.isValid(); --skip)
+            occurrence = recurrence->getNextDateTime(occurrence);
+        if (!occurrence.isValid())
+            break;
+        recurrence->addExDateTime(occurrence);
+    }
+}
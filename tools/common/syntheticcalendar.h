@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2013 Jolla Ltd.
+ * Contact: Aaron Kennedy <aaron.kennedy@jollamobile.com>
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef SYNTHETICCALENDAR_H
+#define SYNTHETICCALENDAR_H
+
+#include <QDate>
+#include <QString>
+
+// mkcal
+#include <event.h>
+
+class QTextStream;
+class QStringList;
+
+// Populates the calendar database opened by NemoCalendarDb with generated
+// events.  The same options always produce the same events, so databases
+// built on different machines or from different commits are comparable.
+class SyntheticCalendar
+{
+public:
+    struct Options {
+        Options();
+
+        quint32 seed;
+        int notebooks;
+        int events;
+        double recurringRatio;      // fraction of events that recur
+        double complexRatio;        // fraction of recurring events with multi-day or positional rules
+        double exceptionDensity;    // average number of exception dates per recurring event
+        double allDayRatio;
+        double alarmRatio;
+        int descriptionSize;        // characters of description per event
+        QDate startDate;            // events start in [startDate, startDate + days)
+        int days;
+    };
+
+    explicit SyntheticCalendar(const Options &options);
+
+    // Reads the generator option at args[index], if any, advancing index
+    // past its value
+    static bool parseOption(const QStringList &args, int &index, Options &options);
+    static QString optionsUsage();
+
+    // Selects the database file used by NemoCalendarDb.  Must be called
+    // before the database is first opened.
+    static void useDatabase(const QString &fileName);
+
+    // Runs the agenda refresh the event cache posts after loads and model
+    // changes, so models are up to date without running the event loop
+    static void drainRefresh();
+
+    bool populate(QTextStream *progress = 0);
+
+private:
+    quint32 next();
+    int bounded(int n);
+    bool chance(double p);
+    QString words(int minimum, int maximum);
+    QString text(int size);
+
+    KCalCore::Event::Ptr createEvent(int index);
+    void setTimes(const KCalCore::Event::Ptr &event);
+    void addAlarm(const KCalCore::Event::Ptr &event);
+    void addRecurrence(const KCalCore::Event::Ptr &event);
+    void addExceptions(const KCalCore::Event::Ptr &event);
+
+    Options mOptions;
+    quint32 mState;
+};
+
+#endif // SYNTHETICCALENDAR_H
@@ -0,0 +1,53 @@
+# Shared settings for the command line tools.  The plugin itself hides its
+# symbols, so the tools compile the engine sources they need.
+
+TEMPLATE = app
+CONFIG += console link_pkgconfig
+CONFIG -= app_bundle
+
+QT += qml
+QT -= gui
+
+PKGCONFIG += libkcalcoren-qt5 libmkcal-qt5 libical
+DEFINES += NEMO_USE_QT5
+LIBS += -lrt
+
+target.path = /usr/bin
+INSTALLS += target
+
+SRC_DIR = $$PWD/../src
+INCLUDEPATH += $$SRC_DIR $$PWD/common
+
+SOURCES += \
+    $$SRC_DIR/calendarevent.cpp \
+    $$SRC_DIR/calendaragendamodel.cpp \
+    $$SRC_DIR/calendardb.cpp \
+    $$SRC_DIR/calendareventcache.cpp \
+    $$SRC_DIR/calendarsearchindex.cpp \
+    $$SRC_DIR/calendaralarmindex.cpp \
+    $$SRC_DIR/calendarupcomingindex.cpp \
+    $$SRC_DIR/calendaroccurrencestore.cpp \
+    $$SRC_DIR/calendarlocalzone.cpp \
+    $$SRC_DIR/calendarstats.cpp \
+    $$SRC_DIR/calendarrecorder.cpp \
+    $$SRC_DIR/calendarsnapshot.cpp \
+    $$SRC_DIR/calendarvcalwriter.cpp \
+    $$SRC_DIR/calendareventquery.cpp \
+    $$PWD/common/syntheticcalendar.cpp \
+
+HEADERS += \
+    $$SRC_DIR/calendarevent.h \
+    $$SRC_DIR/calendaragendamodel.h \
+    $$SRC_DIR/calendardb.h \
+    $$SRC_DIR/calendareventcache.h \
+    $$SRC_DIR/calendarsearchindex.h \
+    $$SRC_DIR/calendaralarmindex.h \
+    $$SRC_DIR/calendarupcomingindex.h \
+    $$SRC_DIR/calendaroccurrencestore.h \
+    $$SRC_DIR/calendarlocalzone.h \
+    $$SRC_DIR/calendarstats.h \
+    $$SRC_DIR/calendarrecorder.h \
+    $$SRC_DIR/calendarsnapshot.h \
+    $$SRC_DIR/calendarvcalwriter.h \
+    $$SRC_DIR/calendareventquery.h \
+    $$PWD/common/syntheticcalendar.h \
@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+# The tools build the plugin's engine sources directly, so they follow the
+# Qt 5 build of the plugin
+equals(QT_MAJOR_VERSION, 5) {
+    SUBDIRS = calendarbench calendargen calendarquery
+}